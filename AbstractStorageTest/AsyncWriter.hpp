@@ -0,0 +1,486 @@
+#pragma once
+
+#include "SinkSet.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// bounded lock-free queue of records, any number of producers and one consumer
+// records are swapped in and out, so their buffers are reused and a warm queue does not allocate
+class RecordRing
+{
+public:
+	explicit RecordRing(std::size_t a_capacity);
+
+	// on success a_record receives an empty buffer of an earlier record, fails when the ring is full
+	bool try_push(std::string & a_record);
+	// one consumer only
+	bool try_pop(std::string & a_record);
+
+	bool empty() const;
+	std::size_t capacity() const { return m_mask + 1; }
+	std::size_t pushed() const { return m_enqueue.load(std::memory_order_acquire); }
+	std::size_t popped() const { return m_dequeue.load(std::memory_order_acquire); }
+private:
+	struct Slot
+	{
+		std::atomic<std::size_t> sequence;
+		std::string bytes;
+	};
+
+	std::unique_ptr<Slot[]> m_slots;
+	std::size_t m_mask;
+	alignas(64) std::atomic<std::size_t> m_enqueue{ 0 };
+	alignas(64) std::atomic<std::size_t> m_dequeue{ 0 };
+};
+
+// delivers records to its streams on a background thread, writers never wait for the streams
+class AsyncWriter
+{
+public:
+	enum class Overflow
+	{
+		Block, // the producer waits for a free slot
+		Drop // the record is dropped and counted
+	};
+
+	enum class PushResult
+	{
+		Pushed,
+		Dropped,
+		Full, // try_push only, the record is kept
+		Deferred // push_or_defer only, the writer thread pushes the record later
+	};
+
+	explicit AsyncWriter(std::size_t a_capacity = 1024, Overflow a_overflow = Overflow::Block);
+	AsyncWriter(const AsyncWriter &) = delete;
+	AsyncWriter & operator=(const AsyncWriter &) = delete;
+	~AsyncWriter() { shutdown(); }
+
+	// thread-safe, the stream is used by the writer thread only from now on
+	AsyncWriter & add_stream(akt::uniform_ptr<std::ostream> && a_ostream);
+
+	// thread-safe; a_record is swapped with a spare buffer, false if the record was dropped
+	bool push(std::string & a_record);
+	// never waits: a record that finds the queue full is kept in a_record, or dropped with Overflow::Drop
+	PushResult try_push(std::string & a_record);
+	// never waits: a record that finds the queue full is kept in a_record and pushed by the writer thread as soon as
+	// there is room, which then calls a_done(true), or a_done(false) if the writer was shut down; a_record has to live until then
+	PushResult push_or_defer(std::string & a_record, std::function<void(bool)> a_done);
+	// returns when every record pushed before the call is written and the streams are flushed
+	void flush();
+	// never waits: true if every record pushed before the call is already written and flushed, otherwise
+	// the writer thread calls a_done() once they are
+	bool flush_or_defer(std::function<void()> a_done);
+	// writes and flushes what is queued and stops the thread, later records are dropped;
+	// the records still deferred by push_or_defer are dropped too, with a_done(false)
+	void shutdown();
+
+	std::size_t queue_depth() const { return m_ring.pushed() - m_ring.popped(); }
+	std::size_t written() const { return m_written.load(std::memory_order_relaxed); }
+	std::size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+private:
+	// times the writer looks for new records before it goes to sleep
+	static constexpr int kSpins = 64;
+
+	void run();
+	bool drain(std::string & a_record);
+	bool push_deferred();
+	bool fail_deferred();
+	void wake();
+
+	struct DeferredPush
+	{
+		std::string * record;
+		std::function<void(bool)> done;
+	};
+
+	RecordRing m_ring;
+	Overflow m_overflow;
+	std::atomic<bool> m_closed{ false };
+	std::atomic<std::size_t> m_producers{ 0 }; // inside push(), shutdown waits for them
+	std::atomic<bool> m_idle{ false };
+	std::atomic<std::size_t> m_written{ 0 };
+	std::atomic<std::size_t> m_dropped{ 0 };
+
+	std::mutex m_deferredMutex;
+	std::deque<DeferredPush> m_deferred;
+	std::atomic<std::size_t> m_deferredCount{ 0 };
+
+	std::mutex m_sinksMutex;
+	SinkSet m_sinks;
+
+	std::mutex m_mutex; // guards the flush positions and the sleep of the writer
+	std::condition_variable m_wake;
+	std::condition_variable m_flushed;
+	std::size_t m_flushTarget = 0;
+	std::size_t m_flushedUpTo = 0;
+	std::vector<std::pair<std::size_t, std::function<void()>>> m_flushWaiters;
+	bool m_stopped = false;
+
+	std::thread m_thread;
+};
+
+inline RecordRing::RecordRing(std::size_t a_capacity)
+{
+	std::size_t capacity = 2;
+	while (capacity < a_capacity)
+	{
+		capacity *= 2;
+	}
+	m_slots.reset(new Slot[capacity]);
+	m_mask = capacity - 1;
+	for (std::size_t i = 0; i < capacity; ++i)
+	{
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+inline bool RecordRing::try_push(std::string & a_record)
+{
+	std::size_t pos = m_enqueue.load(std::memory_order_relaxed);
+	Slot * slot;
+	for (;;)
+	{
+		slot = &m_slots[pos & m_mask];
+		const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+		if (diff == 0)
+		{
+			if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = m_enqueue.load(std::memory_order_relaxed);
+		}
+	}
+	slot->bytes.swap(a_record);
+	a_record.clear();
+	slot->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+inline bool RecordRing::try_pop(std::string & a_record)
+{
+	const std::size_t pos = m_dequeue.load(std::memory_order_relaxed);
+	Slot & slot = m_slots[pos & m_mask];
+	if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+	{
+		return false;
+	}
+	a_record.swap(slot.bytes);
+	slot.sequence.store(pos + m_mask + 1, std::memory_order_release);
+	m_dequeue.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+inline bool RecordRing::empty() const
+{
+	const std::size_t pos = m_dequeue.load(std::memory_order_relaxed);
+	return m_slots[pos & m_mask].sequence.load(std::memory_order_acquire) != pos + 1;
+}
+
+inline AsyncWriter::AsyncWriter(std::size_t a_capacity, Overflow a_overflow)
+	: m_ring(a_capacity)
+	, m_overflow(a_overflow)
+	, m_thread([this]() { run(); })
+{
+}
+
+inline AsyncWriter & AsyncWriter::add_stream(akt::uniform_ptr<std::ostream> && a_ostream)
+{
+	std::lock_guard<std::mutex> lock(m_sinksMutex);
+	m_sinks.add(std::move(a_ostream), true);
+	return *this;
+}
+
+inline bool AsyncWriter::push(std::string & a_record)
+{
+	m_producers.fetch_add(1);
+	bool pushed = false;
+	while (m_closed.load() == false)
+	{
+		if (m_ring.try_push(a_record) == true)
+		{
+			pushed = true;
+			break;
+		}
+		if (m_overflow == Overflow::Drop)
+		{
+			break;
+		}
+		std::this_thread::yield();
+	}
+	m_producers.fetch_sub(1);
+
+	if (pushed == false)
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		a_record.clear();
+		return false;
+	}
+	// pairs with the fence of the writer going to sleep, one of them sees the other
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_idle.load(std::memory_order_relaxed) == true)
+	{
+		wake();
+	}
+	return true;
+}
+
+inline AsyncWriter::PushResult AsyncWriter::try_push(std::string & a_record)
+{
+	m_producers.fetch_add(1);
+	PushResult result = PushResult::Dropped;
+	if (m_closed.load() == false)
+	{
+		// the deferred records of others go first
+		if (m_deferredCount.load() == 0 && m_ring.try_push(a_record) == true)
+		{
+			result = PushResult::Pushed;
+		}
+		else if (m_overflow == Overflow::Block)
+		{
+			result = PushResult::Full;
+		}
+	}
+	m_producers.fetch_sub(1);
+
+	if (result == PushResult::Dropped)
+	{
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		a_record.clear();
+	}
+	else if (result == PushResult::Pushed)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_idle.load(std::memory_order_relaxed) == true)
+		{
+			wake();
+		}
+	}
+	return result;
+}
+
+inline AsyncWriter::PushResult AsyncWriter::push_or_defer(std::string & a_record, std::function<void(bool)> a_done)
+{
+	// counted as a producer until the record is registered, so that shutdown waits for it
+	m_producers.fetch_add(1);
+	PushResult result = try_push(a_record);
+	if (result == PushResult::Full)
+	{
+		std::lock_guard<std::mutex> lock(m_deferredMutex);
+		m_deferred.push_back(DeferredPush{ &a_record, std::move(a_done) });
+		m_deferredCount.fetch_add(1);
+		result = PushResult::Deferred;
+	}
+	m_producers.fetch_sub(1);
+	if (result == PushResult::Deferred)
+	{
+		wake();
+	}
+	return result;
+}
+
+inline bool AsyncWriter::flush_or_defer(std::function<void()> a_done)
+{
+	const std::size_t target = m_ring.pushed();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_flushedUpTo >= target || m_stopped == true)
+	{
+		return true;
+	}
+	if (target > m_flushTarget)
+	{
+		m_flushTarget = target;
+	}
+	m_flushWaiters.emplace_back(target, std::move(a_done));
+	m_wake.notify_one();
+	return false;
+}
+
+inline void AsyncWriter::flush()
+{
+	const std::size_t target = m_ring.pushed();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (target > m_flushTarget)
+	{
+		m_flushTarget = target;
+	}
+	m_wake.notify_one();
+	m_flushed.wait(lock, [&]() { return m_flushedUpTo >= target || m_stopped == true; });
+}
+
+inline void AsyncWriter::shutdown()
+{
+	if (m_thread.joinable() == true)
+	{
+		m_closed.store(true);
+		wake();
+		m_thread.join();
+	}
+}
+
+inline void AsyncWriter::wake()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_wake.notify_one();
+}
+
+// moves deferred records into the ring while it has room, false if none was moved
+inline bool AsyncWriter::push_deferred()
+{
+	if (m_deferredCount.load() == 0)
+	{
+		return false;
+	}
+	std::vector<std::function<void(bool)>> done;
+	{
+		std::lock_guard<std::mutex> lock(m_deferredMutex);
+		while (m_deferred.empty() == false && m_ring.try_push(*m_deferred.front().record) == true)
+		{
+			done.push_back(std::move(m_deferred.front().done));
+			m_deferred.pop_front();
+			m_deferredCount.fetch_sub(1);
+		}
+	}
+	for (auto & callback : done)
+	{
+		callback(true);
+	}
+	return done.empty() == false;
+}
+
+// the writer is shut down: drops the deferred records, false if there were none
+inline bool AsyncWriter::fail_deferred()
+{
+	if (m_deferredCount.load() == 0)
+	{
+		return false;
+	}
+	std::deque<DeferredPush> deferred;
+	{
+		std::lock_guard<std::mutex> lock(m_deferredMutex);
+		deferred.swap(m_deferred);
+		m_deferredCount.fetch_sub(deferred.size());
+	}
+	m_dropped.fetch_add(deferred.size(), std::memory_order_relaxed);
+	for (auto & push : deferred)
+	{
+		push.record->clear();
+		push.done(false);
+	}
+	return deferred.empty() == false;
+}
+
+// false if there was nothing to write
+inline bool AsyncWriter::drain(std::string & a_record)
+{
+	std::lock_guard<std::mutex> lock(m_sinksMutex);
+	bool any = false;
+	while (m_ring.try_pop(a_record) == true)
+	{
+		m_sinks.write(a_record.data(), a_record.size());
+		m_written.fetch_add(1, std::memory_order_relaxed);
+		any = true;
+	}
+	return any;
+}
+
+inline void AsyncWriter::run()
+{
+	std::string record;
+	for (;;)
+	{
+		// a writer that is still awake spares the producers the wake-up of a sleeping one
+		bool busy = drain(record);
+		busy = (m_closed.load() == true ? fail_deferred() : push_deferred()) || busy;
+		for (int spin = 0; busy == false && spin < kSpins && m_closed.load() == false; ++spin)
+		{
+			std::this_thread::yield();
+			busy = drain(record);
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_flushTarget > m_flushedUpTo && m_ring.popped() >= m_flushTarget)
+		{
+			const std::size_t target = m_flushTarget;
+			lock.unlock();
+			{
+				std::lock_guard<std::mutex> sinksLock(m_sinksMutex);
+				m_sinks.flush();
+			}
+			lock.lock();
+			m_flushedUpTo = target;
+			m_flushed.notify_all();
+			std::vector<std::function<void()>> done;
+			for (std::size_t i = m_flushWaiters.size(); i-- > 0;)
+			{
+				if (m_flushWaiters[i].first <= target)
+				{
+					done.push_back(std::move(m_flushWaiters[i].second));
+					m_flushWaiters.erase(m_flushWaiters.begin() + static_cast<std::ptrdiff_t>(i));
+				}
+			}
+			lock.unlock();
+			for (auto & callback : done)
+			{
+				callback();
+			}
+			continue;
+		}
+		if (m_closed.load() == true && m_producers.load() == 0 && m_ring.empty() == true && m_deferredCount.load() == 0)
+		{
+			break;
+		}
+		if (busy == true)
+		{
+			continue;
+		}
+
+		m_idle.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_ring.empty() == true && m_deferredCount.load() == 0 && m_closed.load() == false)
+		{
+			// the timeout only covers a producer that claimed a slot and is still swapping into it
+			const bool flushPending = m_flushTarget > m_flushedUpTo;
+			m_wake.wait_for(lock, std::chrono::milliseconds(flushPending == true ? 1 : 100));
+		}
+		m_idle.store(false, std::memory_order_relaxed);
+	}
+
+	{
+		std::lock_guard<std::mutex> sinksLock(m_sinksMutex);
+		m_sinks.flush();
+	}
+	std::vector<std::pair<std::size_t, std::function<void()>>> waiters;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopped = true;
+		m_flushedUpTo = m_ring.popped();
+		m_flushed.notify_all();
+		waiters.swap(m_flushWaiters);
+	}
+	for (auto & waiter : waiters)
+	{
+		waiter.second();
+	}
+}
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+// the records written by Outputer in Binary mode: a tag byte followed by the raw bytes of the value,
+// in the byte order and sizes of the writing machine, which the Header record describes
+enum class RecordTag : unsigned char
+{
+	Header = 0xB0, // "OUTB", version, sizeof(void *), 0x0102 as uint16_t; starts every stream, literal IDs start over
+	Bool = 1,
+	Char,
+	Int8,
+	Int16,
+	Int32,
+	Int64,
+	UInt8,
+	UInt16,
+	UInt32,
+	UInt64,
+	Float,
+	Double,
+	LongDouble,
+	String, // uint32_t length, bytes
+	Literal, // ID of a string literal defined before
+	LiteralDef, // ID, uint32_t length, bytes; replaces an earlier definition of the ID
+	Text // uint32_t length, bytes formatted by the writer, for values without a binary form
+};
+
+class BinaryEncoder
+{
+public:
+	static constexpr unsigned char kVersion = 1;
+	// literals defined at once; the writer starts over with a Header before it would define one more,
+	// the reader takes a stream with more for a corrupt one
+	static constexpr std::size_t kMaxLiterals = 1024;
+	using LiteralId = std::uintptr_t;
+
+	template <typename T>
+	static constexpr bool has_binary_form();
+
+	static void header(std::streambuf & a_out);
+	// T has to have a binary form
+	template <typename T>
+	static void value(std::streambuf & a_out, const T & a_val);
+	static void string(std::streambuf & a_out, const char * a_data, std::size_t a_size);
+	static void literal(std::streambuf & a_out, LiteralId a_id);
+	static void literal_def(std::streambuf & a_out, LiteralId a_id, const char * a_data, std::size_t a_size);
+	// starts a Text record, its length is patched by end_text once the value is formatted behind it
+	static std::size_t begin_text(std::streambuf & a_out);
+	static void end_text(char * a_record, std::size_t a_textSize);
+private:
+	template <typename T>
+	static RecordTag tag();
+	template <typename T>
+	static void raw(std::streambuf & a_out, const T & a_val) { a_out.sputn(reinterpret_cast<const char *>(&a_val), sizeof(a_val)); }
+	static void put(std::streambuf & a_out, RecordTag a_tag) { a_out.sputc(static_cast<char>(a_tag)); }
+};
+
+// turns the records back into the text Outputer would have written with default formatting
+class BinaryDecoder
+{
+public:
+	// returns false and leaves a message in error() if the input is not a valid record stream
+	bool decode(std::istream & a_in, std::ostream & a_out);
+	const std::string & error() const { return m_error; }
+private:
+	template <typename T>
+	bool print(std::istream & a_in, std::ostream & a_out);
+	bool read_bytes(std::istream & a_in, std::string & a_bytes);
+	bool header(std::istream & a_in);
+	bool fail(const std::string & a_message);
+
+	std::unordered_map<BinaryEncoder::LiteralId, std::string> m_literals;
+	std::string m_bytes;
+	std::string m_error;
+};
+
+template <typename T>
+constexpr bool BinaryEncoder::has_binary_form()
+{
+	using Char = std::remove_cv_t<T>;
+	constexpr bool character = std::is_same_v<Char, char> || std::is_same_v<Char, signed char> || std::is_same_v<Char, unsigned char>;
+	constexpr bool wide = std::is_same_v<Char, wchar_t> || std::is_same_v<Char, char16_t> || std::is_same_v<Char, char32_t>
+#ifdef __cpp_char8_t
+		|| std::is_same_v<Char, char8_t>
+#endif
+		;
+	return std::is_same_v<T, bool> || character || (std::is_integral_v<T> && wide == false) || std::is_floating_point_v<T>
+		|| std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+}
+
+template <typename T>
+RecordTag BinaryEncoder::tag()
+{
+	if constexpr (std::is_same_v<T, bool>)
+	{
+		return RecordTag::Bool;
+	}
+	else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>)
+	{
+		return RecordTag::Char;
+	}
+	else if constexpr (std::is_floating_point_v<T>)
+	{
+		return std::is_same_v<T, float> ? RecordTag::Float : std::is_same_v<T, double> ? RecordTag::Double : RecordTag::LongDouble;
+	}
+	else
+	{
+		constexpr RecordTag first = std::is_signed_v<T> ? RecordTag::Int8 : RecordTag::UInt8;
+		constexpr unsigned step = sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3;
+		static_assert(sizeof(T) <= 8, "no record for integers wider than 64 bits");
+		return static_cast<RecordTag>(static_cast<unsigned>(first) + step);
+	}
+}
+
+inline void BinaryEncoder::header(std::streambuf & a_out)
+{
+	put(a_out, RecordTag::Header);
+	a_out.sputn("OUTB", 4);
+	a_out.sputc(static_cast<char>(kVersion));
+	a_out.sputc(static_cast<char>(sizeof(void *)));
+	raw(a_out, std::uint16_t(0x0102));
+}
+
+template <typename T>
+void BinaryEncoder::value(std::streambuf & a_out, const T & a_val)
+{
+	static_assert(has_binary_form<T>(), "the type has no binary record");
+	if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+	{
+		string(a_out, a_val.data(), a_val.size());
+	}
+	else
+	{
+		put(a_out, tag<std::remove_cv_t<T>>());
+		raw(a_out, a_val);
+	}
+}
+
+inline void BinaryEncoder::string(std::streambuf & a_out, const char * a_data, std::size_t a_size)
+{
+	put(a_out, RecordTag::String);
+	raw(a_out, static_cast<std::uint32_t>(a_size));
+	a_out.sputn(a_data, static_cast<std::streamsize>(a_size));
+}
+
+inline void BinaryEncoder::literal(std::streambuf & a_out, LiteralId a_id)
+{
+	put(a_out, RecordTag::Literal);
+	raw(a_out, a_id);
+}
+
+inline void BinaryEncoder::literal_def(std::streambuf & a_out, LiteralId a_id, const char * a_data, std::size_t a_size)
+{
+	put(a_out, RecordTag::LiteralDef);
+	raw(a_out, a_id);
+	raw(a_out, static_cast<std::uint32_t>(a_size));
+	a_out.sputn(a_data, static_cast<std::streamsize>(a_size));
+}
+
+inline std::size_t BinaryEncoder::begin_text(std::streambuf & a_out)
+{
+	put(a_out, RecordTag::Text);
+	raw(a_out, std::uint32_t(0));
+	return 1 + sizeof(std::uint32_t);
+}
+
+inline void BinaryEncoder::end_text(char * a_record, std::size_t a_textSize)
+{
+	const std::uint32_t size = static_cast<std::uint32_t>(a_textSize);
+	std::memcpy(a_record + 1, &size, sizeof(size));
+}
+
+inline bool BinaryDecoder::decode(std::istream & a_in, std::ostream & a_out)
+{
+	m_error.clear();
+	bool started = false;
+	for (;;)
+	{
+		const auto tag = a_in.get();
+		if (tag == std::istream::traits_type::eof())
+		{
+			return started == true || fail("empty input");
+		}
+		if (started == false && static_cast<RecordTag>(tag) != RecordTag::Header)
+		{
+			return fail("not a binary Outputer stream");
+		}
+		started = true;
+
+		bool ok = true;
+		switch (static_cast<RecordTag>(tag))
+		{
+		case RecordTag::Header: ok = header(a_in); break;
+		case RecordTag::Bool: ok = print<bool>(a_in, a_out); break;
+		case RecordTag::Char: ok = print<char>(a_in, a_out); break;
+		case RecordTag::Int8: ok = print<std::int8_t>(a_in, a_out); break;
+		case RecordTag::Int16: ok = print<std::int16_t>(a_in, a_out); break;
+		case RecordTag::Int32: ok = print<std::int32_t>(a_in, a_out); break;
+		case RecordTag::Int64: ok = print<std::int64_t>(a_in, a_out); break;
+		case RecordTag::UInt8: ok = print<std::uint8_t>(a_in, a_out); break;
+		case RecordTag::UInt16: ok = print<std::uint16_t>(a_in, a_out); break;
+		case RecordTag::UInt32: ok = print<std::uint32_t>(a_in, a_out); break;
+		case RecordTag::UInt64: ok = print<std::uint64_t>(a_in, a_out); break;
+		case RecordTag::Float: ok = print<float>(a_in, a_out); break;
+		case RecordTag::Double: ok = print<double>(a_in, a_out); break;
+		case RecordTag::LongDouble: ok = print<long double>(a_in, a_out); break;
+		case RecordTag::String:
+		case RecordTag::Text:
+			ok = read_bytes(a_in, m_bytes);
+			a_out << m_bytes;
+			break;
+		case RecordTag::Literal:
+		{
+			BinaryEncoder::LiteralId id = 0;
+			ok = static_cast<bool>(a_in.read(reinterpret_cast<char *>(&id), sizeof(id)));
+			const auto literal = m_literals.find(id);
+			if (ok == true && literal == m_literals.end())
+			{
+				return fail("literal used before its definition");
+			}
+			if (ok == true)
+			{
+				a_out << literal->second;
+			}
+			break;
+		}
+		case RecordTag::LiteralDef:
+		{
+			BinaryEncoder::LiteralId id = 0;
+			ok = static_cast<bool>(a_in.read(reinterpret_cast<char *>(&id), sizeof(id)));
+			if (ok == true && m_literals.size() >= BinaryEncoder::kMaxLiterals && m_literals.count(id) == 0)
+			{
+				return fail("more literals defined than a writer keeps");
+			}
+			ok = ok && read_bytes(a_in, m_literals[id]);
+			break;
+		}
+		default:
+			return fail("unknown record tag " + std::to_string(tag));
+		}
+		if (ok == false)
+		{
+			return m_error.empty() == false ? false : fail("truncated record");
+		}
+	}
+}
+
+// integers of one byte are printed as numbers, as Outputer prints them unless they are characters
+template <typename T>
+bool BinaryDecoder::print(std::istream & a_in, std::ostream & a_out)
+{
+	T val{};
+	if (!a_in.read(reinterpret_cast<char *>(&val), sizeof(val)))
+	{
+		return false;
+	}
+	if constexpr (std::is_same_v<T, std::int8_t> || std::is_same_v<T, std::uint8_t>)
+	{
+		a_out << static_cast<int>(val);
+	}
+	else
+	{
+		a_out << val;
+	}
+	return true;
+}
+
+// the size comes from the input, the bytes are read a chunk at a time: a corrupt size fails at the end of the input
+// instead of allocating up to 4 GiB first
+inline bool BinaryDecoder::read_bytes(std::istream & a_in, std::string & a_bytes)
+{
+	constexpr std::size_t kChunk = 64 << 10;
+	std::uint32_t size = 0;
+	if (!a_in.read(reinterpret_cast<char *>(&size), sizeof(size)))
+	{
+		return false;
+	}
+	a_bytes.clear();
+	while (a_bytes.size() < size)
+	{
+		const std::size_t done = a_bytes.size();
+		const std::size_t count = std::min<std::size_t>(kChunk, size - done);
+		a_bytes.resize(done + count);
+		if (!a_in.read(a_bytes.data() + done, static_cast<std::streamsize>(count)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool BinaryDecoder::header(std::istream & a_in)
+{
+	char magic[4] = {};
+	unsigned char version = 0;
+	unsigned char pointerSize = 0;
+	std::uint16_t order = 0;
+	if (!a_in.read(magic, sizeof(magic)) || !a_in.read(reinterpret_cast<char *>(&version), 1) || !a_in.read(reinterpret_cast<char *>(&pointerSize), 1)
+		|| !a_in.read(reinterpret_cast<char *>(&order), sizeof(order)))
+	{
+		return false;
+	}
+	if (std::memcmp(magic, "OUTB", 4) != 0 || version != BinaryEncoder::kVersion)
+	{
+		return fail("not a binary Outputer stream or an unsupported version");
+	}
+	if (pointerSize != sizeof(void *) || order != 0x0102)
+	{
+		return fail("written on a machine with another pointer size or byte order");
+	}
+	m_literals.clear();
+	return true;
+}
+
+inline bool BinaryDecoder::fail(const std::string & a_message)
+{
+	m_error = a_message;
+	return false;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "FastFormat.hpp"
+#include "SinkSet.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// front-end for many producer threads: every thread formats its records into a buffer of its own,
+// a full buffer goes to the streams in one write; records stay whole, the records of one thread stay in order,
+// the records of different threads may be reordered
+class ConcurrentOutputer
+{
+	struct ThreadBuffer;
+public:
+	// the values written to it by one expression, out << a << b << '\n', form one record
+	class Record
+	{
+	public:
+		Record(ConcurrentOutputer & a_owner, ThreadBuffer & a_buffer) : m_owner(a_owner), m_buffer(a_buffer) {}
+		Record(const Record &) = delete;
+		Record & operator=(const Record &) = delete;
+		~Record() { m_owner.commit(m_buffer); }
+
+		template <typename T>
+		Record & operator<<(const T & val);
+	private:
+		ConcurrentOutputer & m_owner;
+		ThreadBuffer & m_buffer;
+	};
+
+	// a_bufferSize bytes of records collect per thread before they are written;
+	// a_flushPeriod above zero writes and flushes what the threads have collected that often, from a thread of its own
+	explicit ConcurrentOutputer(std::size_t a_bufferSize = 64 << 10, std::chrono::milliseconds a_flushPeriod = std::chrono::milliseconds(100));
+	ConcurrentOutputer(const ConcurrentOutputer &) = delete;
+	ConcurrentOutputer & operator=(const ConcurrentOutputer &) = delete;
+	~ConcurrentOutputer();
+
+	// thread-safe
+	ConcurrentOutputer & add_stream(akt::uniform_ptr<std::ostream> && a_ostream);
+	// starts a record of the calling thread; manipulators apply to the later values of that thread
+	template <typename T>
+	Record operator<<(const T & val);
+	// writes what every thread has collected and flushes the streams
+	void flush();
+
+	// writes of collected records to the streams so far
+	std::size_t batches() const { return m_batches.load(std::memory_order_relaxed); }
+private:
+	struct ThreadBuffer
+	{
+		ValueFormatter record; // the record being written, touched by its thread only
+
+		std::mutex mutex; // held while the records are written, keeps the order of the thread
+		std::string records;
+		bool orphaned = false; // the thread has exited
+		std::atomic<bool> closed{ false }; // the ConcurrentOutputer is gone
+	};
+
+	// the buffers of a thread, one per ConcurrentOutputer it wrote to
+	struct ThreadCache
+	{
+		struct Entry
+		{
+			std::uint64_t owner;
+			std::shared_ptr<ThreadBuffer> buffer;
+		};
+
+		~ThreadCache();
+		std::vector<Entry> entries;
+	};
+
+	static std::uint64_t next_id();
+	ThreadBuffer & local_buffer();
+	void commit(ThreadBuffer & a_buffer);
+	// a_buffer.mutex is held
+	void write(ThreadBuffer & a_buffer);
+	void flush_periodically();
+
+	const std::uint64_t m_id;
+	const std::size_t m_bufferSize;
+	const std::chrono::milliseconds m_flushPeriod;
+
+	std::mutex m_sinksMutex;
+	SinkSet m_sinks;
+	std::atomic<std::size_t> m_batches{ 0 };
+
+	std::mutex m_buffersMutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+
+	std::mutex m_flusherMutex;
+	std::condition_variable m_stop;
+	bool m_stopping = false;
+	std::thread m_flusher;
+};
+
+template <typename T>
+ConcurrentOutputer::Record & ConcurrentOutputer::Record::operator<<(const T & val)
+{
+	m_buffer.record.format(val);
+	return *this;
+}
+
+inline ConcurrentOutputer::ThreadCache::~ThreadCache()
+{
+	for (auto & entry : entries)
+	{
+		std::lock_guard<std::mutex> lock(entry.buffer->mutex);
+		entry.buffer->orphaned = true;
+	}
+}
+
+inline ConcurrentOutputer::ConcurrentOutputer(std::size_t a_bufferSize, std::chrono::milliseconds a_flushPeriod)
+	: m_id(next_id())
+	, m_bufferSize(a_bufferSize)
+	, m_flushPeriod(a_flushPeriod)
+{
+	if (m_flushPeriod.count() > 0)
+	{
+		m_flusher = std::thread([this]() { flush_periodically(); });
+	}
+}
+
+inline ConcurrentOutputer::~ConcurrentOutputer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_flusherMutex);
+		m_stopping = true;
+		m_stop.notify_all();
+	}
+	if (m_flusher.joinable() == true)
+	{
+		m_flusher.join();
+	}
+	flush();
+	std::lock_guard<std::mutex> lock(m_buffersMutex);
+	for (auto & buffer : m_buffers)
+	{
+		buffer->closed.store(true, std::memory_order_release);
+	}
+}
+
+inline std::uint64_t ConcurrentOutputer::next_id()
+{
+	static std::atomic<std::uint64_t> next{ 0 };
+	return ++next;
+}
+
+inline ConcurrentOutputer & ConcurrentOutputer::add_stream(akt::uniform_ptr<std::ostream> && a_ostream)
+{
+	std::lock_guard<std::mutex> lock(m_sinksMutex);
+	m_sinks.add(std::move(a_ostream), true);
+	return *this;
+}
+
+template <typename T>
+ConcurrentOutputer::Record ConcurrentOutputer::operator<<(const T & val)
+{
+	ThreadBuffer & buffer = local_buffer();
+	buffer.record.format(val);
+	return Record(*this, buffer);
+}
+
+// IDs are never reused, an entry of an outputer that is gone only waits to be dropped
+inline ConcurrentOutputer::ThreadBuffer & ConcurrentOutputer::local_buffer()
+{
+	thread_local ThreadCache cache;
+	for (auto & entry : cache.entries)
+	{
+		if (entry.owner == m_id)
+		{
+			return *entry.buffer;
+		}
+	}
+
+	auto & entries = cache.entries;
+	for (std::size_t i = entries.size(); i-- > 0;)
+	{
+		if (entries[i].buffer->closed.load(std::memory_order_acquire) == true)
+		{
+			entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(i));
+		}
+	}
+	auto buffer = std::make_shared<ThreadBuffer>();
+	{
+		std::lock_guard<std::mutex> lock(m_buffersMutex);
+		m_buffers.push_back(buffer);
+	}
+	entries.push_back(ThreadCache::Entry{ m_id, buffer });
+	return *buffer;
+}
+
+inline void ConcurrentOutputer::commit(ThreadBuffer & a_buffer)
+{
+	FormatBuffer & record = a_buffer.record.buffer();
+	if (record.size() == 0)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(a_buffer.mutex);
+		a_buffer.records.append(record.data(), record.size());
+		if (a_buffer.records.size() >= m_bufferSize)
+		{
+			write(a_buffer);
+		}
+	}
+	record.clear();
+}
+
+inline void ConcurrentOutputer::write(ThreadBuffer & a_buffer)
+{
+	if (a_buffer.records.empty() == true)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_sinksMutex);
+		m_sinks.write(a_buffer.records.data(), a_buffer.records.size());
+	}
+	a_buffer.records.clear();
+	m_batches.fetch_add(1, std::memory_order_relaxed);
+}
+
+// the buffers of exited threads are dropped once they are written
+inline void ConcurrentOutputer::flush()
+{
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	{
+		std::lock_guard<std::mutex> lock(m_buffersMutex);
+		buffers = m_buffers;
+	}
+	std::vector<ThreadBuffer *> done;
+	for (auto & buffer : buffers)
+	{
+		std::lock_guard<std::mutex> lock(buffer->mutex);
+		write(*buffer);
+		if (buffer->orphaned == true)
+		{
+			done.push_back(buffer.get());
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_sinksMutex);
+		m_sinks.flush();
+	}
+
+	if (done.empty() == false)
+	{
+		std::lock_guard<std::mutex> lock(m_buffersMutex);
+		for (ThreadBuffer * buffer : done)
+		{
+			for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it)
+			{
+				if (it->get() == buffer)
+				{
+					m_buffers.erase(it);
+					break;
+				}
+			}
+		}
+	}
+}
+
+inline void ConcurrentOutputer::flush_periodically()
+{
+	std::unique_lock<std::mutex> lock(m_flusherMutex);
+	while (m_stop.wait_for(lock, m_flushPeriod, [this]() { return m_stopping; }) == false)
+	{
+		lock.unlock();
+		flush();
+		lock.lock();
+	}
+}
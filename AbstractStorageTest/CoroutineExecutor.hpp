@@ -0,0 +1,81 @@
+#pragma once
+
+// where coroutines suspended in Outputer::async_write and async_flush are resumed
+#ifdef __cpp_impl_coroutine
+
+#include <coroutine>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+class CoroutineExecutor
+{
+public:
+	virtual ~CoroutineExecutor() = default;
+	// thread-safe, called from the writer thread
+	virtual void post(std::coroutine_handle<> a_handle) = 0;
+};
+
+// resumes the posted coroutines on the thread that runs it, one at a time
+class SerialExecutor : public CoroutineExecutor
+{
+public:
+	void post(std::coroutine_handle<> a_handle) override;
+	// resumes posted coroutines until a_done() is true, which is checked before every one of them
+	template <typename Done>
+	void run_until(Done a_done);
+	// resumes what is posted, without waiting for more; returns how many
+	std::size_t run_ready();
+private:
+	std::coroutine_handle<> take(bool a_wait);
+
+	std::mutex m_mutex;
+	std::condition_variable m_posted;
+	std::deque<std::coroutine_handle<>> m_ready;
+};
+
+inline void SerialExecutor::post(std::coroutine_handle<> a_handle)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ready.push_back(a_handle);
+	m_posted.notify_one();
+}
+
+template <typename Done>
+void SerialExecutor::run_until(Done a_done)
+{
+	while (a_done() == false)
+	{
+		take(true).resume();
+	}
+}
+
+inline std::size_t SerialExecutor::run_ready()
+{
+	std::size_t count = 0;
+	for (auto handle = take(false); handle; handle = take(false))
+	{
+		handle.resume();
+		++count;
+	}
+	return count;
+}
+
+inline std::coroutine_handle<> SerialExecutor::take(bool a_wait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (a_wait == true)
+	{
+		m_posted.wait(lock, [&]() { return m_ready.empty() == false; });
+	}
+	if (m_ready.empty() == true)
+	{
+		return nullptr;
+	}
+	const auto handle = m_ready.front();
+	m_ready.pop_front();
+	return handle;
+}
+
+#endif
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <locale>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// growing in-memory buffer, collects the formatted bytes of values
+class FormatBuffer : public std::streambuf
+{
+public:
+	char * data() { return pbase(); }
+	const char * data() const { return pbase(); }
+	std::size_t size() const { return static_cast<std::size_t>(pptr() - pbase()); }
+	void clear() { setp(m_bytes.data(), m_bytes.data() + m_bytes.size()); }
+
+	void append(const char * a_data, std::size_t a_size);
+	// room for a_size bytes at the end, commit() the ones that were written
+	char * reserve(std::size_t a_size);
+	void commit(char * a_end) { pbump(static_cast<int>(a_end - pptr())); }
+protected:
+	int_type overflow(int_type ch) override;
+private:
+	void grow(std::size_t a_size);
+
+	std::vector<char> m_bytes;
+};
+
+// formats values straight into a FormatBuffer, as an ostream with default flags and the classic locale would:
+// arithmetic types by std::to_chars, strings by copying them;
+// a type becomes supported by a function void fast_format(FormatBuffer &, const T &) found by argument-dependent lookup,
+// which may append() its members
+class FastFormat
+{
+public:
+	template <typename T>
+	static constexpr bool supports();
+
+	template <typename T>
+	static void append(FormatBuffer & a_out, const T & a_val);
+private:
+	template <typename T, typename = void>
+	struct HasUserFormat : std::false_type {};
+	template <typename T>
+	struct HasUserFormat<T, std::void_t<decltype(fast_format(std::declval<FormatBuffer &>(), std::declval<const T &>()))>> : std::true_type {};
+
+	template <typename T>
+	static constexpr bool is_character() { return std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>; }
+	template <typename T>
+	static constexpr bool is_number();
+};
+
+// formats values into its buffer: by FastFormat while stream() has the default flags, precision and the classic locale,
+// by stream() otherwise, so that manipulators and imbue() written to it apply
+class ValueFormatter
+{
+public:
+	ValueFormatter();
+	ValueFormatter(const ValueFormatter &) = delete;
+	ValueFormatter & operator=(const ValueFormatter &) = delete;
+
+	FormatBuffer & buffer() { return m_buffer; }
+	std::ostream & stream() { return m_stream; }
+	// clears a failure of the previous value first, false if the stream failed on this one
+	template <typename T>
+	bool format(const T & a_val);
+private:
+	bool plain() const;
+	static void locale_changed(std::ios_base::event a_event, std::ios_base & a_stream, int a_index);
+
+	FormatBuffer m_buffer;
+	std::ostream m_stream;
+	bool m_classicLocale; // of m_stream
+};
+
+inline void FormatBuffer::append(const char * a_data, std::size_t a_size)
+{
+	std::copy(a_data, a_data + a_size, reserve(a_size));
+	pbump(static_cast<int>(a_size));
+}
+
+inline char * FormatBuffer::reserve(std::size_t a_size)
+{
+	if (static_cast<std::size_t>(epptr() - pptr()) < a_size)
+	{
+		grow(a_size);
+	}
+	return pptr();
+}
+
+inline FormatBuffer::int_type FormatBuffer::overflow(int_type ch)
+{
+	grow(1);
+	if (traits_type::eq_int_type(ch, traits_type::eof()) == false)
+	{
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+inline void FormatBuffer::grow(std::size_t a_size)
+{
+	const std::size_t used = size();
+	m_bytes.resize(std::max<std::size_t>({ m_bytes.size() * 2, used + a_size, 256 }));
+	setp(m_bytes.data(), m_bytes.data() + m_bytes.size());
+	pbump(static_cast<int>(used));
+}
+
+template <typename T>
+constexpr bool FastFormat::is_number()
+{
+	// floating-point std::to_chars is missing from older standard libraries
+#ifdef __cpp_lib_to_chars
+	constexpr bool floating = std::is_floating_point_v<T>;
+#else
+	constexpr bool floating = false;
+#endif
+	constexpr bool wide = std::is_same_v<T, wchar_t> || std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>
+#ifdef __cpp_char8_t
+		|| std::is_same_v<T, char8_t>
+#endif
+		;
+	return (std::is_integral_v<T> && is_character<T>() == false && wide == false) || floating;
+}
+
+template <typename T>
+constexpr bool FastFormat::supports()
+{
+	using Plain = std::remove_cv_t<std::decay_t<T>>;
+	return is_character<Plain>() || is_number<Plain>() || std::is_same_v<Plain, const char *> || std::is_same_v<Plain, char *>
+		|| std::is_same_v<Plain, std::string> || std::is_same_v<Plain, std::string_view> || HasUserFormat<T>::value;
+}
+
+// a null C string is not supported, the caller has to check it
+template <typename T>
+void FastFormat::append(FormatBuffer & a_out, const T & a_val)
+{
+	using Plain = std::remove_cv_t<std::decay_t<T>>;
+	static_assert(supports<T>(), "the type has no fast format, write it to an ostream");
+	if constexpr (std::is_same_v<Plain, bool>)
+	{
+		a_out.append(a_val == true ? "1" : "0", 1);
+	}
+	else if constexpr (is_character<Plain>())
+	{
+		a_out.append(reinterpret_cast<const char *>(&a_val), 1);
+	}
+	else if constexpr (std::is_integral_v<Plain> && is_number<Plain>())
+	{
+		constexpr std::size_t kDigits = 24;
+		char * const first = a_out.reserve(kDigits);
+		a_out.commit(std::to_chars(first, first + kDigits, a_val).ptr);
+	}
+	else if constexpr (is_number<Plain>())
+	{
+		// %g with the default precision of ostream
+		constexpr std::size_t kChars = 32;
+		char * const first = a_out.reserve(kChars);
+		a_out.commit(std::to_chars(first, first + kChars, a_val, std::chars_format::general, 6).ptr);
+	}
+	else if constexpr (std::is_same_v<Plain, const char *> || std::is_same_v<Plain, char *>)
+	{
+		const char * const text = a_val;
+		a_out.append(text, std::char_traits<char>::length(text));
+	}
+	else if constexpr (std::is_same_v<Plain, std::string> || std::is_same_v<Plain, std::string_view>)
+	{
+		a_out.append(a_val.data(), a_val.size());
+	}
+	else
+	{
+		fast_format(a_out, a_val);
+	}
+}
+
+// keeps m_classicLocale up to date when the stream is imbued
+inline ValueFormatter::ValueFormatter()
+	: m_stream(&m_buffer)
+	, m_classicLocale(m_stream.getloc() == std::locale::classic())
+{
+	static const int index = std::ios_base::xalloc();
+	m_stream.pword(index) = &m_classicLocale;
+	m_stream.register_callback(&ValueFormatter::locale_changed, index);
+}
+
+template <typename T>
+bool ValueFormatter::format(const T & a_val)
+{
+	if (m_stream.rdstate() != std::ios::goodbit)
+	{
+		m_stream.clear();
+	}
+	if constexpr (FastFormat::supports<T>())
+	{
+		if (plain() == true)
+		{
+			if constexpr (std::is_pointer_v<std::decay_t<T>>)
+			{
+				// a null C string fails the stream, as it fails any other
+				const char * const text = a_val;
+				if (text == nullptr)
+				{
+					m_stream << text;
+					return false;
+				}
+			}
+			FastFormat::append(m_buffer, a_val);
+			return true;
+		}
+	}
+	m_stream << a_val;
+	return m_stream.fail() == false;
+}
+
+inline bool ValueFormatter::plain() const
+{
+	return m_classicLocale == true && m_stream.rdstate() == std::ios::goodbit && m_stream.flags() == (std::ios::skipws | std::ios::dec)
+		&& m_stream.width() == 0 && m_stream.precision() == 6;
+}
+
+inline void ValueFormatter::locale_changed(std::ios_base::event a_event, std::ios_base & a_stream, int a_index)
+{
+	if (a_event == std::ios_base::imbue_event)
+	{
+		*static_cast<bool *>(a_stream.pword(a_index)) = a_stream.getloc() == std::locale::classic();
+	}
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+#include "SinkSet.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// gives every stream its own queue, served by a pool of worker threads:
+// a stream that blocks delays only its own records
+class LaneWriter
+{
+public:
+	enum class Overflow
+	{
+		Block, // the producer waits until the lane has room
+		DropOldest, // the oldest queued records of the lane make room
+		DropNewest // the new record is not queued to the lane
+	};
+
+	struct LaneStats
+	{
+		std::size_t queued_bytes = 0;
+		std::size_t in_flight_bytes = 0; // taken by the worker and not yet written, they count against the capacity too
+		std::size_t written = 0; // records
+		std::size_t dropped = 0; // records
+	};
+
+	// a_capacity bytes may be queued or being written per lane, a larger record is queued only to an empty lane;
+	// a_workers is the size of the pool, 0 starts one worker per stream
+	explicit LaneWriter(std::size_t a_capacity = 1 << 20, Overflow a_overflow = Overflow::Block, std::size_t a_workers = 0);
+	LaneWriter(const LaneWriter &) = delete;
+	LaneWriter & operator=(const LaneWriter &) = delete;
+	~LaneWriter() { shutdown(); }
+
+	// thread-safe, returns the index of the lane
+	std::size_t add_stream(akt::uniform_ptr<std::ostream> && a_ostream);
+
+	// thread-safe, queues a copy of the record to every lane
+	void write(const char * a_data, std::size_t a_size);
+	// returns when every record queued before the call is written and the streams are flushed
+	void flush();
+	// writes and flushes what is queued and stops the workers, later records are dropped
+	void shutdown();
+
+	std::size_t lanes() const;
+	LaneStats stats(std::size_t a_lane) const;
+private:
+	struct Lane
+	{
+		SinkSet::Sink sink; // touched by the worker that holds the lane only
+
+		mutable std::mutex mutex;
+		std::condition_variable changed; // room for records, progress of flushes
+		std::deque<std::string> records;
+		std::vector<std::string> spare; // buffers of written records, reused
+		std::size_t bytes = 0;
+		std::size_t inFlight = 0; // bytes of the batch being written
+		std::size_t queued = 0; // records ever queued
+		std::size_t done = 0; // records ever written or dropped after they were queued
+		std::size_t flushTarget = 0;
+		std::size_t flushedUpTo = 0;
+		std::size_t written = 0;
+		std::size_t dropped = 0;
+		bool scheduled = false; // waits for a worker or is being written
+		bool closed = false;
+	};
+
+	void queue(Lane & a_lane, const char * a_data, std::size_t a_size);
+	void schedule(Lane & a_lane);
+	void work();
+	void serve(Lane & a_lane);
+	bool has_room(const Lane & a_lane, std::size_t a_size) const { return (a_lane.records.empty() == true && a_lane.inFlight == 0) || a_lane.bytes + a_lane.inFlight + a_size <= m_capacity; }
+	bool flush_due(const Lane & a_lane) const { return a_lane.flushTarget > a_lane.flushedUpTo && a_lane.done >= a_lane.flushTarget; }
+
+	const std::size_t m_capacity;
+	const Overflow m_overflow;
+	const std::size_t m_maxWorkers;
+
+	mutable std::shared_mutex m_lanesMutex;
+	std::vector<std::unique_ptr<Lane>> m_lanes;
+
+	std::mutex m_poolMutex;
+	std::condition_variable m_work;
+	std::deque<Lane *> m_ready;
+	std::vector<std::thread> m_workers;
+	bool m_stopping = false;
+};
+
+inline LaneWriter::LaneWriter(std::size_t a_capacity, Overflow a_overflow, std::size_t a_workers)
+	: m_capacity(a_capacity)
+	, m_overflow(a_overflow)
+	, m_maxWorkers(a_workers)
+{
+	for (std::size_t i = 0; i < a_workers; ++i)
+	{
+		m_workers.emplace_back([this]() { work(); });
+	}
+}
+
+inline std::size_t LaneWriter::add_stream(akt::uniform_ptr<std::ostream> && a_ostream)
+{
+	auto lane = std::make_unique<Lane>();
+	lane->sink = SinkSet::make_sink(std::move(a_ostream), true);
+
+	std::unique_lock<std::shared_mutex> lock(m_lanesMutex);
+	{
+		std::lock_guard<std::mutex> poolLock(m_poolMutex);
+		if (m_stopping == true)
+		{
+			lane->closed = true;
+		}
+		else if (m_maxWorkers == 0)
+		{
+			m_workers.emplace_back([this]() { work(); });
+		}
+	}
+	m_lanes.push_back(std::move(lane));
+	return m_lanes.size() - 1;
+}
+
+inline void LaneWriter::write(const char * a_data, std::size_t a_size)
+{
+	if (a_size == 0)
+	{
+		return;
+	}
+	std::shared_lock<std::shared_mutex> lock(m_lanesMutex);
+	for (auto & lane : m_lanes)
+	{
+		queue(*lane, a_data, a_size);
+	}
+}
+
+inline void LaneWriter::queue(Lane & a_lane, const char * a_data, std::size_t a_size)
+{
+	std::unique_lock<std::mutex> lock(a_lane.mutex);
+	if (m_overflow == Overflow::Block)
+	{
+		a_lane.changed.wait(lock, [&]() { return a_lane.closed || has_room(a_lane, a_size); });
+	}
+	else if (m_overflow == Overflow::DropOldest)
+	{
+		while (a_lane.records.empty() == false && has_room(a_lane, a_size) == false)
+		{
+			a_lane.bytes -= a_lane.records.front().size();
+			a_lane.spare.push_back(std::move(a_lane.records.front()));
+			a_lane.records.pop_front();
+			++a_lane.dropped;
+			++a_lane.done;
+		}
+	}
+	if (a_lane.closed == true || has_room(a_lane, a_size) == false)
+	{
+		++a_lane.dropped;
+		return;
+	}
+
+	std::string record;
+	if (a_lane.spare.empty() == false)
+	{
+		record = std::move(a_lane.spare.back());
+		a_lane.spare.pop_back();
+	}
+	record.assign(a_data, a_size);
+	a_lane.records.push_back(std::move(record));
+	a_lane.bytes += a_size;
+	++a_lane.queued;
+	if (a_lane.scheduled == false)
+	{
+		a_lane.scheduled = true;
+		lock.unlock();
+		schedule(a_lane);
+	}
+}
+
+inline void LaneWriter::schedule(Lane & a_lane)
+{
+	std::lock_guard<std::mutex> lock(m_poolMutex);
+	m_ready.push_back(&a_lane);
+	m_work.notify_one();
+}
+
+inline void LaneWriter::flush()
+{
+	std::shared_lock<std::shared_mutex> lanesLock(m_lanesMutex);
+	for (auto & lanePtr : m_lanes)
+	{
+		Lane & lane = *lanePtr;
+		std::unique_lock<std::mutex> lock(lane.mutex);
+		const std::size_t target = lane.queued;
+		if (target <= lane.flushedUpTo)
+		{
+			continue;
+		}
+		if (target > lane.flushTarget)
+		{
+			lane.flushTarget = target;
+		}
+		if (lane.scheduled == false)
+		{
+			lane.scheduled = true;
+			lock.unlock();
+			schedule(lane);
+			lock.lock();
+		}
+		lane.changed.wait(lock, [&]() { return lane.flushedUpTo >= target; });
+	}
+}
+
+inline void LaneWriter::shutdown()
+{
+	{
+		std::shared_lock<std::shared_mutex> lock(m_lanesMutex);
+		for (auto & lane : m_lanes)
+		{
+			std::lock_guard<std::mutex> laneLock(lane->mutex);
+			lane->closed = true;
+			lane->changed.notify_all();
+		}
+	}
+	flush();
+	{
+		std::lock_guard<std::mutex> lock(m_poolMutex);
+		m_stopping = true;
+		m_work.notify_all();
+	}
+	for (auto & worker : m_workers)
+	{
+		if (worker.joinable() == true)
+		{
+			worker.join();
+		}
+	}
+}
+
+inline std::size_t LaneWriter::lanes() const
+{
+	std::shared_lock<std::shared_mutex> lock(m_lanesMutex);
+	return m_lanes.size();
+}
+
+inline LaneWriter::LaneStats LaneWriter::stats(std::size_t a_lane) const
+{
+	std::shared_lock<std::shared_mutex> lock(m_lanesMutex);
+	const Lane & lane = *m_lanes.at(a_lane);
+	std::lock_guard<std::mutex> laneLock(lane.mutex);
+	LaneStats stats;
+	stats.queued_bytes = lane.bytes;
+	stats.in_flight_bytes = lane.inFlight;
+	stats.written = lane.written;
+	stats.dropped = lane.dropped;
+	return stats;
+}
+
+inline void LaneWriter::work()
+{
+	for (;;)
+	{
+		Lane * lane = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_poolMutex);
+			m_work.wait(lock, [&]() { return m_stopping || m_ready.empty() == false; });
+			if (m_ready.empty() == true)
+			{
+				return;
+			}
+			lane = m_ready.front();
+			m_ready.pop_front();
+		}
+		serve(*lane);
+	}
+}
+
+// writes what the lane has queued, the lane goes back to the end of the ready queue if more arrived meanwhile;
+// the batch holds its room in the lane until it is written
+inline void LaneWriter::serve(Lane & a_lane)
+{
+	std::deque<std::string> batch;
+	{
+		std::lock_guard<std::mutex> lock(a_lane.mutex);
+		batch.swap(a_lane.records);
+		a_lane.inFlight = a_lane.bytes;
+		a_lane.bytes = 0;
+	}
+
+	for (auto & record : batch)
+	{
+		SinkSet::write(a_lane.sink, record.data(), record.size());
+	}
+
+	std::unique_lock<std::mutex> lock(a_lane.mutex);
+	a_lane.inFlight = 0;
+	a_lane.changed.notify_all();
+	if (a_lane.sink.healthy == true)
+	{
+		a_lane.written += batch.size();
+	}
+	else
+	{
+		a_lane.dropped += batch.size();
+	}
+	a_lane.done += batch.size();
+	for (auto & record : batch)
+	{
+		if (a_lane.spare.size() < 64)
+		{
+			a_lane.spare.push_back(std::move(record));
+		}
+	}
+
+	if (flush_due(a_lane) == true)
+	{
+		const std::size_t target = a_lane.flushTarget;
+		lock.unlock();
+		SinkSet::flush(a_lane.sink);
+		lock.lock();
+		a_lane.flushedUpTo = target;
+		a_lane.changed.notify_all();
+	}
+
+	if (a_lane.records.empty() == false || a_lane.flushTarget > a_lane.flushedUpTo)
+	{
+		lock.unlock();
+		schedule(a_lane);
+	}
+	else
+	{
+		a_lane.scheduled = false;
+	}
+}
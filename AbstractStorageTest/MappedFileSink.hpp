@@ -0,0 +1,256 @@
+#pragma once
+
+// POSIX file stream for Outputer sinks: bytes are copied straight into a memory-mapped window of the file,
+// the file grows a chunk at a time and rolls over to the next file at a size limit
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+// writes a_path, then a_path.1, a_path.2, ... each at most a_maxFileSize bytes long (0 means no limit);
+// while open, the current file is longer than its contents by the unused part of the chunk, close() cuts it
+class MappedFileBuf : public std::streambuf
+{
+public:
+	static constexpr std::size_t kDefaultChunk = 4 << 20;
+
+	explicit MappedFileBuf(const std::string & a_path, std::size_t a_maxFileSize = 0, std::size_t a_chunkSize = kDefaultChunk);
+	MappedFileBuf(const MappedFileBuf &) = delete;
+	MappedFileBuf & operator=(const MappedFileBuf &) = delete;
+	~MappedFileBuf() override { close(); }
+
+	bool is_open() const { return m_fd >= 0; }
+	// index of the current file, 0 for a_path itself
+	std::size_t file_index() const { return m_index; }
+	std::string file_path(std::size_t a_index) const;
+	// cuts the current file to its contents and closes it, false if anything failed
+	bool close();
+protected:
+	int_type overflow(int_type ch) override;
+	std::streamsize xsputn(const char * s, std::streamsize n) override;
+private:
+	std::size_t file_size() const { return m_windowOffset + static_cast<std::size_t>(pptr() - pbase()); }
+	bool open_file();
+	bool reserve_chunk();
+	bool map_window();
+	bool advance();
+	bool roll();
+	bool finish_file();
+
+	std::string m_path;
+	std::size_t m_maxFileSize;
+	std::size_t m_chunk;
+	std::size_t m_index = 0;
+	int m_fd = -1;
+	char * m_window = nullptr;
+	std::size_t m_windowOffset = 0;
+	bool m_failed = false;
+};
+
+// owns its MappedFileBuf, can be registered with Outputer::add_stream
+class MappedFileStream : public std::ostream
+{
+public:
+	explicit MappedFileStream(const std::string & a_path, std::size_t a_maxFileSize = 0, std::size_t a_chunkSize = MappedFileBuf::kDefaultChunk)
+		: std::ostream(nullptr)
+		, m_buffer(a_path, a_maxFileSize, a_chunkSize)
+	{
+		rdbuf(&m_buffer);
+		if (m_buffer.is_open() == false)
+		{
+			setstate(std::ios::badbit);
+		}
+	}
+
+	std::size_t file_index() const { return m_buffer.file_index(); }
+	std::string file_path(std::size_t a_index) const { return m_buffer.file_path(a_index); }
+	void close()
+	{
+		if (m_buffer.close() == false)
+		{
+			setstate(std::ios::badbit);
+		}
+	}
+private:
+	MappedFileBuf m_buffer;
+};
+
+inline MappedFileBuf::MappedFileBuf(const std::string & a_path, std::size_t a_maxFileSize, std::size_t a_chunkSize)
+	: m_path(a_path)
+	, m_maxFileSize(a_maxFileSize)
+{
+	// windows start at multiples of the chunk, which has to be a multiple of the page
+	const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	m_chunk = std::max<std::size_t>((a_chunkSize + page - 1) / page * page, page);
+	if (open_file() == false || map_window() == false)
+	{
+		close();
+	}
+}
+
+inline std::string MappedFileBuf::file_path(std::size_t a_index) const
+{
+	return a_index == 0 ? m_path : m_path + "." + std::to_string(a_index);
+}
+
+inline bool MappedFileBuf::close()
+{
+	if (m_fd >= 0 && finish_file() == false)
+	{
+		m_failed = true;
+	}
+	return m_failed == false;
+}
+
+inline MappedFileBuf::int_type MappedFileBuf::overflow(int_type ch)
+{
+	if (advance() == false)
+	{
+		return traits_type::eof();
+	}
+	if (traits_type::eq_int_type(ch, traits_type::eof()) == false)
+	{
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+inline std::streamsize MappedFileBuf::xsputn(const char * s, std::streamsize n)
+{
+	if (m_fd < 0)
+	{
+		return 0;
+	}
+	// a write that fits a file is not split between two
+	const std::size_t size = static_cast<std::size_t>(n);
+	if (m_maxFileSize != 0 && file_size() != 0 && file_size() + size > m_maxFileSize && size <= m_maxFileSize && roll() == false)
+	{
+		return 0;
+	}
+	std::size_t done = 0;
+	while (done < size)
+	{
+		const std::size_t room = static_cast<std::size_t>(epptr() - pptr());
+		if (room == 0)
+		{
+			if (advance() == false)
+			{
+				break;
+			}
+			continue;
+		}
+		const std::size_t count = std::min(room, size - done);
+		std::memcpy(pptr(), s + done, count);
+		pbump(static_cast<int>(count));
+		done += count;
+	}
+	return static_cast<std::streamsize>(done);
+}
+
+inline bool MappedFileBuf::open_file()
+{
+	m_fd = ::open(file_path(m_index).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	m_windowOffset = 0;
+	return m_fd >= 0;
+}
+
+// extends the file by a chunk with its blocks allocated: a store into a sparse hole of the mapping
+// would raise SIGBUS once the disk is full, instead of failing the stream
+inline bool MappedFileBuf::reserve_chunk()
+{
+#if defined(__APPLE__)
+	fstore_t store = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(m_chunk), 0 };
+	return ::fcntl(m_fd, F_PREALLOCATE, &store) != -1 && ::ftruncate(m_fd, static_cast<off_t>(m_windowOffset + m_chunk)) == 0;
+#else
+	return ::posix_fallocate(m_fd, static_cast<off_t>(m_windowOffset), static_cast<off_t>(m_chunk)) == 0;
+#endif
+}
+
+// reserves the next chunk and maps it, the put area ends at the chunk or at the size limit
+inline bool MappedFileBuf::map_window()
+{
+	if (reserve_chunk() == false)
+	{
+		m_failed = true;
+		return false;
+	}
+	void * const window = ::mmap(nullptr, m_chunk, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, static_cast<off_t>(m_windowOffset));
+	if (window == MAP_FAILED)
+	{
+		return false;
+	}
+	m_window = static_cast<char *>(window);
+	std::size_t end = m_chunk;
+	if (m_maxFileSize != 0)
+	{
+		end = std::min(end, m_maxFileSize - m_windowOffset);
+	}
+	setp(m_window, m_window + end);
+	return true;
+}
+
+// the put area is full: maps the next chunk or starts the next file
+inline bool MappedFileBuf::advance()
+{
+	if (m_fd < 0 || m_failed == true)
+	{
+		return false;
+	}
+	if (m_maxFileSize != 0 && file_size() >= m_maxFileSize)
+	{
+		return roll();
+	}
+	::munmap(m_window, m_chunk);
+	m_window = nullptr;
+	m_windowOffset += m_chunk;
+	setp(nullptr, nullptr);
+	if (map_window() == false)
+	{
+		m_failed = true;
+		return false;
+	}
+	return true;
+}
+
+inline bool MappedFileBuf::roll()
+{
+	if (finish_file() == false)
+	{
+		m_failed = true;
+		return false;
+	}
+	++m_index;
+	if (open_file() == false || map_window() == false)
+	{
+		m_failed = true;
+		return false;
+	}
+	return true;
+}
+
+inline bool MappedFileBuf::finish_file()
+{
+	const std::size_t size = m_window != nullptr ? file_size() : m_windowOffset;
+	bool ok = true;
+	if (m_window != nullptr)
+	{
+		ok = ::munmap(m_window, m_chunk) == 0;
+		m_window = nullptr;
+	}
+	setp(nullptr, nullptr);
+	ok = ::ftruncate(m_fd, static_cast<off_t>(size)) == 0 && ok;
+	ok = ::close(m_fd) == 0 && ok;
+	m_fd = -1;
+	return ok;
+}
+
+#endif
@@ -0,0 +1,475 @@
+#pragma once
+
+#include "AsyncWriter.hpp"
+#include "BinaryRecord.hpp"
+#include "CoroutineExecutor.hpp"
+#include "FastFormat.hpp"
+#include "LaneWriter.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// writes every value to all registered streams
+class Outputer
+{
+public:
+	enum class Mode
+	{
+		PerStream, // every stream formats the value with its own flags and locale
+		FormatOnce, // the value is formatted once and its bytes are copied to every stream
+		Async, // as FormatOnce, but complete lines are handed to an AsyncWriter that writes them on its own thread
+		Parallel, // as Async, but every stream has its own queue in a LaneWriter, a slow stream delays only itself
+		// every value goes to all streams as a typed record, see BinaryRecord.hpp, OutputerDecoder turns them back into text;
+		// manipulators reach only the values formatted into Text records, native values are decoded with default formatting
+		Binary
+	};
+
+	explicit Outputer(Mode a_mode = Mode::PerStream);
+	// Async mode; several Outputers, one per producer thread, may share the writer
+	explicit Outputer(std::shared_ptr<AsyncWriter> a_writer);
+	// Parallel mode, the writer may be shared in the same way
+	explicit Outputer(std::shared_ptr<LaneWriter> a_lanes);
+	Outputer(const Outputer &) = delete;
+	Outputer & operator=(const Outputer &) = delete;
+	~Outputer();
+
+	Outputer & add_stream(akt::uniform_ptr<std::ostream> && a_ostream);
+	template <typename T>
+	Outputer & operator<<(const T & val);
+	// string literals, written by their address in Binary mode
+	template <std::size_t N>
+	Outputer & operator<<(const char (&val)[N]);
+	template <std::size_t N>
+	Outputer & operator<<(char (&val)[N]) { return operator<< <char[N]>(val); }
+	// in Async and Parallel modes also hands over an unfinished line and waits for the writer
+	void flush();
+
+#ifdef __cpp_impl_coroutine
+	class WriteAwaiter;
+	class FlushAwaiter;
+	// co_await out.async_write(val) writes as operator<< does, but in Async mode a complete line that finds the queue
+	// of the writer full suspends the coroutine instead of the thread; it is resumed once the line is queued,
+	// through a_executor or, without one, on the writer thread, where it must not wait for the writer.
+	// co_await yields false if the line was dropped. Other modes write synchronously and do not suspend.
+	template <typename T>
+	WriteAwaiter async_write(const T & val, CoroutineExecutor * a_executor = nullptr);
+	// as flush(), but in Async mode the coroutine is suspended until the writer has written and flushed
+	FlushAwaiter async_flush(CoroutineExecutor * a_executor = nullptr);
+#endif
+
+	// formats the values unless in PerStream mode, manipulators written to Outputer apply to it, see ValueFormatter
+	std::ostream & formatter() { return m_formatter.stream(); }
+	// nullptr unless in Async mode
+	AsyncWriter * writer() const { return m_writer.get(); }
+	// nullptr unless in Parallel mode
+	LaneWriter * lanes() const { return m_lanes.get(); }
+private:
+	// records longer than this are handed over before their line ends
+	static constexpr std::size_t kMaxRecord = 4096;
+
+	void push_record();
+#ifdef __cpp_impl_coroutine
+	static void resume(CoroutineExecutor * a_executor, std::coroutine_handle<> a_handle);
+#endif
+	// false if the value failed to format
+	template <typename T>
+	bool encode(const T & a_val);
+	void encode_literal(const char * a_data, std::size_t a_size);
+
+	Mode m_mode;
+	SinkSet m_sinks;
+	ValueFormatter m_formatter;
+	std::shared_ptr<AsyncWriter> m_writer;
+	std::shared_ptr<LaneWriter> m_lanes;
+	std::string m_record;
+	std::unordered_map<const char *, std::string> m_literals; // Binary mode, the literals defined in the streams
+};
+
+#ifdef __cpp_impl_coroutine
+class Outputer::WriteAwaiter
+{
+public:
+	// nothing to queue without a_writer; the awaiter keeps the line until the writer has it, so that other
+	// coroutines may write to the same Outputer while this one is suspended
+	WriteAwaiter(AsyncWriter * a_writer, std::string a_record, CoroutineExecutor * a_executor)
+		: m_writer(a_writer)
+		, m_record(std::move(a_record))
+		, m_executor(a_executor)
+	{
+	}
+
+	bool await_ready();
+	bool await_suspend(std::coroutine_handle<> a_handle);
+	bool await_resume() const { return m_queued; }
+private:
+	AsyncWriter * m_writer;
+	std::string m_record;
+	CoroutineExecutor * m_executor;
+	bool m_queued = true;
+};
+
+class Outputer::FlushAwaiter
+{
+public:
+	// nothing to wait for without a_writer, a_record is the unfinished line or empty, kept as by WriteAwaiter
+	FlushAwaiter(AsyncWriter * a_writer, std::string a_record, CoroutineExecutor * a_executor)
+		: m_writer(a_writer)
+		, m_record(std::move(a_record))
+		, m_executor(a_executor)
+	{
+	}
+
+	bool await_ready() const { return m_writer == nullptr; }
+	bool await_suspend(std::coroutine_handle<> a_handle);
+	void await_resume() const {}
+private:
+	bool flush(std::coroutine_handle<> a_handle);
+
+	AsyncWriter * m_writer;
+	std::string m_record;
+	CoroutineExecutor * m_executor;
+};
+#endif
+
+inline Outputer::Outputer(Mode a_mode)
+	: m_mode(a_mode)
+{
+	if (m_mode == Mode::Async)
+	{
+		m_writer = std::make_shared<AsyncWriter>();
+	}
+	else if (m_mode == Mode::Parallel)
+	{
+		m_lanes = std::make_shared<LaneWriter>();
+	}
+}
+
+inline Outputer::Outputer(std::shared_ptr<AsyncWriter> a_writer)
+	: m_mode(Mode::Async)
+	, m_writer(std::move(a_writer))
+{
+}
+
+inline Outputer::Outputer(std::shared_ptr<LaneWriter> a_lanes)
+	: m_mode(Mode::Parallel)
+	, m_lanes(std::move(a_lanes))
+{
+}
+
+inline Outputer::~Outputer()
+{
+	push_record();
+}
+
+inline Outputer & Outputer::add_stream(akt::uniform_ptr<std::ostream> && a_ostream)
+{
+	if (m_mode == Mode::Async)
+	{
+		m_writer->add_stream(std::move(a_ostream));
+	}
+	else if (m_mode == Mode::Parallel)
+	{
+		m_lanes->add_stream(std::move(a_ostream));
+	}
+	else if (m_mode == Mode::Binary)
+	{
+		// a stream added later gets the literals defined before it
+		SinkSet::Sink & sink = m_sinks.add(std::move(a_ostream), true);
+		m_formatter.buffer().clear();
+		BinaryEncoder::header(m_formatter.buffer());
+		for (const auto & literal : m_literals)
+		{
+			BinaryEncoder::literal_def(m_formatter.buffer(), reinterpret_cast<BinaryEncoder::LiteralId>(literal.first), literal.second.data(), literal.second.size());
+		}
+		SinkSet::write(sink, m_formatter.buffer().data(), m_formatter.buffer().size());
+		m_formatter.buffer().clear();
+	}
+	else
+	{
+		m_sinks.add(std::move(a_ostream), m_mode == Mode::FormatOnce);
+	}
+	return *this;
+}
+
+template <typename T>
+Outputer & Outputer::operator<<(const T & val)
+{
+	if (m_mode == Mode::FormatOnce)
+	{
+		m_formatter.buffer().clear();
+		if (m_formatter.format(val) == false)
+		{
+			m_sinks.fail();
+			return *this;
+		}
+		m_sinks.write(m_formatter.buffer().data(), m_formatter.buffer().size());
+		return *this;
+	}
+	if (m_mode == Mode::Binary)
+	{
+		m_formatter.buffer().clear();
+		if (encode(val) == false)
+		{
+			m_sinks.fail();
+			return *this;
+		}
+		m_sinks.write(m_formatter.buffer().data(), m_formatter.buffer().size());
+		return *this;
+	}
+	if (m_mode == Mode::Async || m_mode == Mode::Parallel)
+	{
+		if (m_formatter.format(val) == false)
+		{
+			std::cerr << "invalid stream" << std::endl;
+		}
+		const std::size_t size = m_formatter.buffer().size();
+		if (size != 0 && (m_formatter.buffer().data()[size - 1] == '\n' || size >= kMaxRecord))
+		{
+			push_record();
+		}
+		return *this;
+	}
+
+	for (auto & sink : m_sinks)
+	{
+		if (sink.stream != nullptr)
+		{
+			if (sink.stream->fail() != true)
+			{
+				if (sink.metrics != nullptr)
+				{
+					sink.metrics->write(*sink.stream, val);
+				}
+				else
+				{
+					*sink.stream << val;
+				}
+			}
+			else
+			{
+				std::cerr << "invalid stream" << std::endl;
+				if (sink.metrics != nullptr)
+				{
+					sink.metrics->add_failure();
+				}
+			}
+		}
+		else
+		{
+			std::cerr << "failed to out value" << std::endl;
+			if (sink.metrics != nullptr)
+			{
+				sink.metrics->add_failure();
+			}
+		}
+	}
+	return *this;
+}
+
+template <std::size_t N>
+Outputer & Outputer::operator<<(const char (&val)[N])
+{
+	if (m_mode != Mode::Binary)
+	{
+		return operator<< <char[N]>(val);
+	}
+	m_formatter.buffer().clear();
+	encode_literal(val, static_cast<std::size_t>(std::find(val, val + N, '\0') - val));
+	m_sinks.write(m_formatter.buffer().data(), m_formatter.buffer().size());
+	return *this;
+}
+
+// values without a binary form are formatted into a Text record
+template <typename T>
+bool Outputer::encode(const T & a_val)
+{
+	if constexpr (BinaryEncoder::has_binary_form<T>())
+	{
+		BinaryEncoder::value(m_formatter.buffer(), a_val);
+		return true;
+	}
+	else if constexpr (std::is_same_v<std::decay_t<T>, const char *> || std::is_same_v<std::decay_t<T>, char *>)
+	{
+		// a null pointer is left to formatter(), as in the other modes
+		const char * const text = a_val;
+		if (text != nullptr)
+		{
+			BinaryEncoder::string(m_formatter.buffer(), text, std::char_traits<char>::length(text));
+			return true;
+		}
+	}
+	const std::size_t start = BinaryEncoder::begin_text(m_formatter.buffer());
+	if (m_formatter.format(a_val) == false)
+	{
+		m_formatter.buffer().clear();
+		return false;
+	}
+	if (m_formatter.buffer().size() == start)
+	{
+		m_formatter.buffer().clear(); // manipulators write nothing
+		return true;
+	}
+	BinaryEncoder::end_text(m_formatter.buffer().data(), m_formatter.buffer().size() - start);
+	return true;
+}
+
+// the address identifies a literal; its bytes are compared with the definition, so that an array
+// that reuses the address of another one with other contents is defined again;
+// a full table is dropped and a Header tells the streams to drop theirs, the literals in use are defined again
+inline void Outputer::encode_literal(const char * a_data, std::size_t a_size)
+{
+	const auto found = m_literals.find(a_data);
+	if (found == m_literals.end() || found->second.compare(0, std::string::npos, a_data, a_size) != 0)
+	{
+		if (found == m_literals.end() && m_literals.size() >= BinaryEncoder::kMaxLiterals)
+		{
+			m_literals.clear();
+			BinaryEncoder::header(m_formatter.buffer());
+		}
+		m_literals[a_data].assign(a_data, a_size);
+		BinaryEncoder::literal_def(m_formatter.buffer(), reinterpret_cast<BinaryEncoder::LiteralId>(a_data), a_data, a_size);
+	}
+	BinaryEncoder::literal(m_formatter.buffer(), reinterpret_cast<BinaryEncoder::LiteralId>(a_data));
+}
+
+inline void Outputer::flush()
+{
+	if (m_mode == Mode::Async)
+	{
+		push_record();
+		m_writer->flush();
+	}
+	else if (m_mode == Mode::Parallel)
+	{
+		push_record();
+		m_lanes->flush();
+	}
+	else
+	{
+		m_sinks.flush();
+	}
+}
+
+#ifdef __cpp_impl_coroutine
+template <typename T>
+Outputer::WriteAwaiter Outputer::async_write(const T & val, CoroutineExecutor * a_executor)
+{
+	if (m_mode != Mode::Async)
+	{
+		*this << val;
+		return WriteAwaiter(nullptr, std::string(), a_executor);
+	}
+	if (m_formatter.format(val) == false)
+	{
+		std::cerr << "invalid stream" << std::endl;
+	}
+	FormatBuffer & buffer = m_formatter.buffer();
+	if (buffer.size() == 0 || (buffer.data()[buffer.size() - 1] != '\n' && buffer.size() < kMaxRecord))
+	{
+		return WriteAwaiter(nullptr, std::string(), a_executor);
+	}
+	std::string record(buffer.data(), buffer.size());
+	buffer.clear();
+	return WriteAwaiter(m_writer.get(), std::move(record), a_executor);
+}
+
+inline Outputer::FlushAwaiter Outputer::async_flush(CoroutineExecutor * a_executor)
+{
+	if (m_mode != Mode::Async)
+	{
+		flush();
+		return FlushAwaiter(nullptr, std::string(), a_executor);
+	}
+	FormatBuffer & buffer = m_formatter.buffer();
+	std::string record(buffer.data(), buffer.size());
+	buffer.clear();
+	return FlushAwaiter(m_writer.get(), std::move(record), a_executor);
+}
+
+inline void Outputer::resume(CoroutineExecutor * a_executor, std::coroutine_handle<> a_handle)
+{
+	if (a_executor != nullptr)
+	{
+		a_executor->post(a_handle);
+	}
+	else
+	{
+		a_handle.resume();
+	}
+}
+
+inline bool Outputer::WriteAwaiter::await_ready()
+{
+	if (m_writer == nullptr)
+	{
+		return true;
+	}
+	const AsyncWriter::PushResult result = m_writer->try_push(m_record);
+	m_queued = result == AsyncWriter::PushResult::Pushed;
+	return result != AsyncWriter::PushResult::Full;
+}
+
+// the coroutine may be resumed on another thread before this returns, the awaiter is not touched after a deferral
+inline bool Outputer::WriteAwaiter::await_suspend(std::coroutine_handle<> a_handle)
+{
+	const AsyncWriter::PushResult result = m_writer->push_or_defer(m_record, [this, a_handle](bool a_queued) {
+		m_queued = a_queued;
+		Outputer::resume(m_executor, a_handle);
+	});
+	if (result == AsyncWriter::PushResult::Deferred)
+	{
+		return true;
+	}
+	m_queued = result == AsyncWriter::PushResult::Pushed;
+	return false;
+}
+
+// hands over the unfinished line first, the flush is requested once it is queued
+inline bool Outputer::FlushAwaiter::await_suspend(std::coroutine_handle<> a_handle)
+{
+	if (m_record.empty() == false)
+	{
+		const AsyncWriter::PushResult result = m_writer->push_or_defer(m_record, [this, a_handle](bool) {
+			if (flush(a_handle) == false)
+			{
+				Outputer::resume(m_executor, a_handle);
+			}
+		});
+		if (result == AsyncWriter::PushResult::Deferred)
+		{
+			return true;
+		}
+	}
+	return flush(a_handle);
+}
+
+// false if everything is flushed already
+inline bool Outputer::FlushAwaiter::flush(std::coroutine_handle<> a_handle)
+{
+	CoroutineExecutor * const executor = m_executor;
+	return m_writer->flush_or_defer([executor, a_handle]() { Outputer::resume(executor, a_handle); }) == false;
+}
+#endif
+
+// hands the collected bytes over in Async and Parallel modes
+inline void Outputer::push_record()
+{
+	if (m_formatter.buffer().size() == 0)
+	{
+		return;
+	}
+	if (m_mode == Mode::Async)
+	{
+		m_record.assign(m_formatter.buffer().data(), m_formatter.buffer().size());
+		m_writer->push(m_record);
+	}
+	else if (m_mode == Mode::Parallel)
+	{
+		m_lanes->write(m_formatter.buffer().data(), m_formatter.buffer().size());
+	}
+	m_formatter.buffer().clear();
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ios>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+// counters of one stream registered with Outputer, AsyncWriter, LaneWriter or ConcurrentOutputer;
+// kept when the code is compiled with OUTPUTER_SINK_METRICS, see SinkSet.hpp
+class SinkMetrics
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	// bucket i counts the writes that took less than 2^i ns and at least 2^(i-1) ns, the last one also the slower ones
+	static constexpr std::size_t kBuckets = 32;
+
+	struct Snapshot
+	{
+		std::uint64_t id = 0; // in the order the sinks were added
+		const void * stream = nullptr;
+		std::uint64_t bytes = 0;
+		std::uint64_t records = 0; // writes that succeeded
+		std::uint64_t failures = 0; // writes and flushes that failed or were skipped because the stream had failed
+		std::array<std::uint64_t, kBuckets> latency{};
+	};
+
+	// registers the counters of a_stream, they are dropped from snapshot_all() with the returned pointer
+	static std::shared_ptr<SinkMetrics> create(const void * a_stream);
+	// the counters of every sink alive
+	static std::vector<Snapshot> snapshot_all();
+	// one line per sink, key=value pairs separated by spaces, the latency as upper bound in ns:count for the used buckets:
+	// sink_metrics dump=1 id=4 stream=0x55d0c3a1e2f0 bytes=1200 records=30 failures=0 latency_ns=256:12,512:18
+	static void dump(std::ostream & a_out, const std::vector<Snapshot> & a_snapshots, std::uint64_t a_dump = 0);
+
+	// writes a_val to a_stream, as in PerStream mode, and counts it: the bytes pass through a ByteCounter put in front of
+	// the streambuf of a_stream for the write, the latency covers the write only
+	template <typename T>
+	void write(std::ostream & a_stream, const T & a_val);
+
+	// thread-safe
+	void add_write(std::size_t a_bytes, Clock::duration a_latency, bool a_failed);
+	void add_failure() { m_failures.fetch_add(1, std::memory_order_relaxed); }
+	Snapshot snapshot() const;
+private:
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::weak_ptr<SinkMetrics>> sinks;
+		std::uint64_t next = 0;
+	};
+
+	static Registry & registry();
+
+	std::uint64_t m_id = 0;
+	const void * m_stream = nullptr;
+	std::atomic<std::uint64_t> m_bytes{ 0 };
+	std::atomic<std::uint64_t> m_records{ 0 };
+	std::atomic<std::uint64_t> m_failures{ 0 };
+	std::array<std::atomic<std::uint64_t>, kBuckets> m_latency{};
+};
+
+// passes the bytes on to another streambuf and counts them
+class ByteCounter : public std::streambuf
+{
+public:
+	explicit ByteCounter(std::streambuf * a_target) : m_target(a_target) {}
+	std::size_t count() const { return m_count; }
+protected:
+	std::streamsize xsputn(const char * s, std::streamsize n) override
+	{
+		const std::streamsize done = m_target->sputn(s, n);
+		m_count += static_cast<std::size_t>(done);
+		return done;
+	}
+	int_type overflow(int_type ch) override
+	{
+		if (traits_type::eq_int_type(ch, traits_type::eof()) == true)
+		{
+			return traits_type::not_eof(ch);
+		}
+		const int_type put = m_target->sputc(traits_type::to_char_type(ch));
+		if (traits_type::eq_int_type(put, traits_type::eof()) == false)
+		{
+			++m_count;
+		}
+		return put;
+	}
+	int sync() override { return m_target->pubsync(); }
+private:
+	std::streambuf * m_target;
+	std::size_t m_count = 0;
+};
+
+// writes SinkMetrics::dump of every sink to a stream periodically, from a thread of its own
+class SinkMetricsDumper
+{
+public:
+	SinkMetricsDumper(std::ostream & a_out, std::chrono::milliseconds a_period);
+	SinkMetricsDumper(const SinkMetricsDumper &) = delete;
+	SinkMetricsDumper & operator=(const SinkMetricsDumper &) = delete;
+	~SinkMetricsDumper();
+private:
+	void run();
+
+	std::ostream & m_out;
+	const std::chrono::milliseconds m_period;
+	std::mutex m_mutex;
+	std::condition_variable m_stop;
+	bool m_stopping = false;
+	std::thread m_thread;
+};
+
+inline SinkMetrics::Registry & SinkMetrics::registry()
+{
+	static Registry registry;
+	return registry;
+}
+
+inline std::shared_ptr<SinkMetrics> SinkMetrics::create(const void * a_stream)
+{
+	auto metrics = std::make_shared<SinkMetrics>();
+	metrics->m_stream = a_stream;
+	Registry & sinks = registry();
+	std::lock_guard<std::mutex> lock(sinks.mutex);
+	metrics->m_id = ++sinks.next;
+	sinks.sinks.push_back(metrics);
+	return metrics;
+}
+
+inline std::vector<SinkMetrics::Snapshot> SinkMetrics::snapshot_all()
+{
+	std::vector<std::shared_ptr<SinkMetrics>> alive;
+	{
+		Registry & sinks = registry();
+		std::lock_guard<std::mutex> lock(sinks.mutex);
+		for (auto & weak : sinks.sinks)
+		{
+			if (auto metrics = weak.lock())
+			{
+				alive.push_back(std::move(metrics));
+			}
+		}
+		sinks.sinks.erase(std::remove_if(sinks.sinks.begin(), sinks.sinks.end(), [](const std::weak_ptr<SinkMetrics> & a_sink) { return a_sink.expired(); }),
+			sinks.sinks.end());
+	}
+	std::vector<Snapshot> snapshots;
+	snapshots.reserve(alive.size());
+	for (auto & metrics : alive)
+	{
+		snapshots.push_back(metrics->snapshot());
+	}
+	return snapshots;
+}
+
+inline void SinkMetrics::dump(std::ostream & a_out, const std::vector<Snapshot> & a_snapshots, std::uint64_t a_dump)
+{
+	const auto flags = a_out.flags(std::ios::dec);
+	for (const auto & sink : a_snapshots)
+	{
+		a_out << "sink_metrics dump=" << a_dump << " id=" << sink.id << " stream=0x" << std::hex << reinterpret_cast<std::uintptr_t>(sink.stream)
+			<< std::dec << " bytes=" << sink.bytes << " records=" << sink.records << " failures=" << sink.failures << " latency_ns=";
+		const char * separator = "";
+		for (std::size_t i = 0; i < kBuckets; ++i)
+		{
+			if (sink.latency[i] != 0)
+			{
+				a_out << separator << (std::uint64_t(1) << i) << ':' << sink.latency[i];
+				separator = ",";
+			}
+		}
+		a_out << '\n';
+	}
+	a_out.flags(flags);
+	a_out.flush();
+}
+
+// rdbuf() clears the state of the stream, the state the write left is put back with the streambuf
+template <typename T>
+void SinkMetrics::write(std::ostream & a_stream, const T & a_val)
+{
+	std::streambuf * const target = a_stream.rdbuf();
+	ByteCounter counter(target);
+	a_stream.rdbuf(&counter);
+	const auto start = Clock::now();
+	try
+	{
+		a_stream << a_val;
+	}
+	catch (...)
+	{
+		// the exceptions of the stream are on, the write throws as it would without the counter
+		const std::ios::iostate state = a_stream.rdstate();
+		a_stream.rdbuf(target);
+		a_stream.setstate(state);
+		throw;
+	}
+	const Clock::duration latency = Clock::now() - start;
+	const std::ios::iostate state = a_stream.rdstate();
+	a_stream.rdbuf(target);
+	a_stream.setstate(state);
+	add_write(counter.count(), latency, (state & (std::ios::failbit | std::ios::badbit)) != 0);
+}
+
+inline void SinkMetrics::add_write(std::size_t a_bytes, Clock::duration a_latency, bool a_failed)
+{
+	if (a_failed == true)
+	{
+		m_failures.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		m_bytes.fetch_add(a_bytes, std::memory_order_relaxed);
+		m_records.fetch_add(1, std::memory_order_relaxed);
+	}
+	auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(a_latency).count());
+	std::size_t bucket = 0;
+	while (ns != 0 && bucket < kBuckets - 1)
+	{
+		ns >>= 1;
+		++bucket;
+	}
+	m_latency[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+inline SinkMetrics::Snapshot SinkMetrics::snapshot() const
+{
+	Snapshot snapshot;
+	snapshot.id = m_id;
+	snapshot.stream = m_stream;
+	snapshot.bytes = m_bytes.load(std::memory_order_relaxed);
+	snapshot.records = m_records.load(std::memory_order_relaxed);
+	snapshot.failures = m_failures.load(std::memory_order_relaxed);
+	for (std::size_t i = 0; i < kBuckets; ++i)
+	{
+		snapshot.latency[i] = m_latency[i].load(std::memory_order_relaxed);
+	}
+	return snapshot;
+}
+
+inline SinkMetricsDumper::SinkMetricsDumper(std::ostream & a_out, std::chrono::milliseconds a_period)
+	: m_out(a_out)
+	, m_period(a_period)
+	, m_thread([this]() { run(); })
+{
+}
+
+inline SinkMetricsDumper::~SinkMetricsDumper()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_stop.notify_all();
+	}
+	m_thread.join();
+}
+
+inline void SinkMetricsDumper::run()
+{
+	std::uint64_t dump = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_stop.wait_for(lock, m_period, [this]() { return m_stopping; }) == false)
+	{
+		SinkMetrics::dump(m_out, SinkMetrics::snapshot_all(), ++dump);
+	}
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "../uniform_ptr.hpp"
+
+#include "SinkMetrics.hpp"
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+// the streams that receive already formatted bytes
+class SinkSet
+{
+public:
+	struct Sink
+	{
+		akt::uniform_ptr<std::ostream> ostr;
+		std::ostream * stream; // ostr.get(), cached
+		bool healthy; // checked when added and after every write, a failed sink is skipped from then on
+		// null unless compiled with OUTPUTER_SINK_METRICS, which counts the bytes, records, failures and write latency
+		// of every sink, see SinkMetrics.hpp; Sink is the same with or without it
+		std::shared_ptr<SinkMetrics> metrics;
+	};
+
+	static Sink make_sink(akt::uniform_ptr<std::ostream> && a_ostream, bool a_report);
+	static void write(Sink & a_sink, const char * a_data, std::size_t a_size);
+	static void flush(Sink & a_sink);
+
+	Sink & add(akt::uniform_ptr<std::ostream> && a_ostream, bool a_report);
+	void write(const char * a_data, std::size_t a_size);
+	void flush();
+	// a value failed to format, every sink fails as its stream would have failed on the value
+	void fail();
+
+	std::vector<Sink>::iterator begin() { return m_sinks.begin(); }
+	std::vector<Sink>::iterator end() { return m_sinks.end(); }
+private:
+	std::vector<Sink> m_sinks;
+};
+
+inline SinkSet::Sink SinkSet::make_sink(akt::uniform_ptr<std::ostream> && a_ostream, bool a_report)
+{
+	std::ostream * const stream = a_ostream.get();
+	const bool healthy = stream != nullptr && stream->fail() != true;
+	if (a_report == true && healthy == false)
+	{
+		std::cerr << (stream == nullptr ? "failed to out value" : "invalid stream") << std::endl;
+	}
+#ifdef OUTPUTER_SINK_METRICS
+	std::shared_ptr<SinkMetrics> metrics = SinkMetrics::create(stream);
+#else
+	std::shared_ptr<SinkMetrics> metrics;
+#endif
+	return Sink{ std::move(a_ostream), stream, healthy, std::move(metrics) };
+}
+
+inline void SinkSet::write(Sink & a_sink, const char * a_data, std::size_t a_size)
+{
+	if (a_sink.healthy == true && a_size != 0)
+	{
+		const SinkMetrics::Clock::time_point start = a_sink.metrics != nullptr ? SinkMetrics::Clock::now() : SinkMetrics::Clock::time_point();
+		a_sink.stream->write(a_data, static_cast<std::streamsize>(a_size));
+		if (a_sink.stream->fail() == true)
+		{
+			a_sink.healthy = false;
+			std::cerr << "invalid stream" << std::endl;
+		}
+		if (a_sink.metrics != nullptr)
+		{
+			a_sink.metrics->add_write(a_size, SinkMetrics::Clock::now() - start, a_sink.healthy == false);
+		}
+	}
+	else if (a_size != 0 && a_sink.metrics != nullptr)
+	{
+		a_sink.metrics->add_failure();
+	}
+}
+
+inline void SinkSet::flush(Sink & a_sink)
+{
+	if (a_sink.healthy == true && a_sink.stream->flush().fail() == true)
+	{
+		a_sink.healthy = false;
+		std::cerr << "invalid stream" << std::endl;
+		if (a_sink.metrics != nullptr)
+		{
+			a_sink.metrics->add_failure();
+		}
+	}
+}
+
+inline SinkSet::Sink & SinkSet::add(akt::uniform_ptr<std::ostream> && a_ostream, bool a_report)
+{
+	m_sinks.push_back(make_sink(std::move(a_ostream), a_report));
+	return m_sinks.back();
+}
+
+inline void SinkSet::write(const char * a_data, std::size_t a_size)
+{
+	for (auto & sink : m_sinks)
+	{
+		write(sink, a_data, a_size);
+	}
+}
+
+inline void SinkSet::flush()
+{
+	for (auto & sink : m_sinks)
+	{
+		flush(sink);
+	}
+}
+
+inline void SinkSet::fail()
+{
+	for (auto & sink : m_sinks)
+	{
+		if (sink.healthy == true)
+		{
+			sink.healthy = false;
+			std::cerr << "invalid stream" << std::endl;
+		}
+		if (sink.metrics != nullptr)
+		{
+			sink.metrics->add_failure();
+		}
+	}
+}
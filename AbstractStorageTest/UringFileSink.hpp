@@ -0,0 +1,505 @@
+#pragma once
+
+// Linux file stream for Outputer sinks: buffered writes go to the file through io_uring, several of them in flight,
+// or through pwritev batches of full buffers where io_uring is not available
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#if __has_include(<linux/io_uring.h>)
+
+#include <linux/io_uring.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// the part of io_uring the file sink needs: one writev per buffer, waited for in any order
+class IoUring
+{
+public:
+	explicit IoUring(unsigned a_entries);
+	IoUring(const IoUring &) = delete;
+	IoUring & operator=(const IoUring &) = delete;
+	~IoUring() { release(); }
+
+	bool valid() const { return m_fd >= 0; }
+	// queues and submits a write of a_iov at a_offset, the iovec has to live until the completion
+	bool submit_writev(int a_fd, const iovec * a_iov, std::uint64_t a_offset, std::uint64_t a_userData);
+	// waits for one completion; a_result is the number of bytes written or -errno
+	bool wait(std::uint64_t & a_userData, int & a_result);
+private:
+	void release();
+
+	int m_fd = -1;
+	void * m_sqRing = MAP_FAILED;
+	void * m_cqRing = MAP_FAILED;
+	std::size_t m_sqRingSize = 0;
+	std::size_t m_cqRingSize = 0;
+	io_uring_sqe * m_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+	std::size_t m_sqesSize = 0;
+
+	unsigned * m_sqTail = nullptr;
+	unsigned * m_sqMask = nullptr;
+	unsigned * m_sqArray = nullptr;
+	unsigned * m_cqHead = nullptr;
+	unsigned * m_cqTail = nullptr;
+	unsigned * m_cqMask = nullptr;
+	io_uring_cqe * m_cqes = nullptr;
+};
+
+inline IoUring::IoUring(unsigned a_entries)
+{
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	const long fd = syscall(__NR_io_uring_setup, a_entries, &params);
+	if (fd < 0)
+	{
+		return;
+	}
+	m_fd = static_cast<int>(fd);
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMmap == true && m_cqRingSize > m_sqRingSize)
+	{
+		m_sqRingSize = m_cqRingSize;
+	}
+	m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	m_cqRing = singleMmap == true ? m_sqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	m_sqes = static_cast<io_uring_sqe *>(mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+	if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED)
+	{
+		release();
+		return;
+	}
+
+	char * const sq = static_cast<char *>(m_sqRing);
+	m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	m_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	char * const cq = static_cast<char *>(m_cqRing);
+	m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	m_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+inline void IoUring::release()
+{
+	if (m_sqes != MAP_FAILED)
+	{
+		munmap(m_sqes, m_sqesSize);
+		m_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+	}
+	if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+	{
+		munmap(m_cqRing, m_cqRingSize);
+	}
+	m_cqRing = MAP_FAILED;
+	if (m_sqRing != MAP_FAILED)
+	{
+		munmap(m_sqRing, m_sqRingSize);
+		m_sqRing = MAP_FAILED;
+	}
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+inline bool IoUring::submit_writev(int a_fd, const iovec * a_iov, std::uint64_t a_offset, std::uint64_t a_userData)
+{
+	// the ring is used by one thread, only the kernel side needs the atomics
+	const unsigned tail = *m_sqTail;
+	const unsigned index = tail & *m_sqMask;
+	io_uring_sqe & sqe = m_sqes[index];
+	std::memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_WRITEV;
+	sqe.fd = a_fd;
+	sqe.addr = reinterpret_cast<std::uint64_t>(a_iov);
+	sqe.len = 1;
+	sqe.off = a_offset;
+	sqe.user_data = a_userData;
+	m_sqArray[index] = index;
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	long submitted;
+	do
+	{
+		submitted = syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, nullptr, 0);
+	} while (submitted < 0 && errno == EINTR);
+	return submitted == 1;
+}
+
+inline bool IoUring::wait(std::uint64_t & a_userData, int & a_result)
+{
+	for (;;)
+	{
+		const unsigned head = *m_cqHead;
+		if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+		{
+			const io_uring_cqe & cqe = m_cqes[head & *m_cqMask];
+			a_userData = cqe.user_data;
+			a_result = cqe.res;
+			__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+		if (syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+		{
+			return false;
+		}
+	}
+}
+
+#else
+
+// built without the io_uring header the ring is never valid, UringFileBuf writes with pwritev
+class IoUring
+{
+public:
+	explicit IoUring(unsigned) {}
+
+	bool valid() const { return false; }
+	bool submit_writev(int, const iovec *, std::uint64_t, std::uint64_t) { return false; }
+	bool wait(std::uint64_t &, int &) { return false; }
+};
+
+#endif
+
+// streambuf writing to a file in large buffers, kBuffers of them may be on their way to the file at once
+class UringFileBuf : public std::streambuf
+{
+public:
+	enum class Backend
+	{
+		Auto, // io_uring if the kernel allows it, pwritev otherwise
+		Pwritev
+	};
+
+	static constexpr std::size_t kBuffers = 4;
+	static constexpr std::size_t kBufferSize = 64 * 1024;
+
+	explicit UringFileBuf(const std::string & a_path, bool a_append = false, Backend a_backend = Backend::Auto);
+	UringFileBuf(const UringFileBuf &) = delete;
+	UringFileBuf & operator=(const UringFileBuf &) = delete;
+	~UringFileBuf() override { close(); }
+
+	bool is_open() const { return m_fd >= 0; }
+	bool uses_uring() const { return m_ring != nullptr; }
+	// writes out everything and closes the file, false if anything failed
+	bool close();
+protected:
+	int_type overflow(int_type ch) override;
+	int sync() override;
+private:
+	enum class State
+	{
+		Free,
+		Filled, // waits for a pwritev batch
+		InFlight // submitted to io_uring
+	};
+
+	struct Buffer
+	{
+		std::unique_ptr<char[]> bytes;
+		iovec iov;
+		std::uint64_t offset;
+		State state;
+	};
+
+	bool hand_over_current();
+	bool acquire_buffer();
+	bool complete_one();
+	bool write_filled();
+	bool wait_all();
+	void set_current(std::size_t a_index);
+
+	int m_fd = -1;
+	std::unique_ptr<IoUring> m_ring;
+	Buffer m_buffers[kBuffers];
+	std::size_t m_current = 0;
+	std::size_t m_next = 0; // round-robin, keeps the pwritev batches in file order
+	std::uint64_t m_offset = 0; // where the current buffer goes
+	std::size_t m_inFlight = 0;
+	bool m_failed = false;
+};
+
+// owns its UringFileBuf, can be registered with Outputer::add_stream
+class UringFileStream : public std::ostream
+{
+public:
+	explicit UringFileStream(const std::string & a_path, bool a_append = false, UringFileBuf::Backend a_backend = UringFileBuf::Backend::Auto)
+		: std::ostream(nullptr)
+		, m_buffer(a_path, a_append, a_backend)
+	{
+		rdbuf(&m_buffer);
+		if (m_buffer.is_open() == false)
+		{
+			setstate(std::ios::badbit);
+		}
+	}
+
+	bool uses_uring() const { return m_buffer.uses_uring(); }
+	void close()
+	{
+		if (m_buffer.close() == false)
+		{
+			setstate(std::ios::badbit);
+		}
+	}
+private:
+	UringFileBuf m_buffer;
+};
+
+inline UringFileBuf::UringFileBuf(const std::string & a_path, bool a_append, Backend a_backend)
+{
+	m_fd = ::open(a_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (a_append == true ? 0 : O_TRUNC), 0644);
+	if (m_fd < 0)
+	{
+		return;
+	}
+	if (a_append == true)
+	{
+		const off_t end = ::lseek(m_fd, 0, SEEK_END);
+		m_offset = end > 0 ? static_cast<std::uint64_t>(end) : 0;
+	}
+	if (a_backend == Backend::Auto)
+	{
+		m_ring = std::make_unique<IoUring>(static_cast<unsigned>(kBuffers));
+		if (m_ring->valid() == false)
+		{
+			m_ring.reset();
+		}
+	}
+	for (std::size_t i = 0; i < kBuffers; ++i)
+	{
+		m_buffers[i].bytes.reset(new char[kBufferSize]);
+		m_buffers[i].state = State::Free;
+	}
+	set_current(0);
+	m_next = 1;
+}
+
+inline void UringFileBuf::set_current(std::size_t a_index)
+{
+	m_current = a_index;
+	char * const bytes = m_buffers[a_index].bytes.get();
+	setp(bytes, bytes + kBufferSize);
+}
+
+inline UringFileBuf::int_type UringFileBuf::overflow(int_type ch)
+{
+	if (m_fd < 0 || m_failed == true || hand_over_current() == false || acquire_buffer() == false)
+	{
+		return traits_type::eof();
+	}
+	if (traits_type::eq_int_type(ch, traits_type::eof()) == false)
+	{
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+inline int UringFileBuf::sync()
+{
+	if (m_fd < 0 || m_failed == true)
+	{
+		return -1;
+	}
+	if (pptr() == pbase())
+	{
+		return wait_all() == true ? 0 : -1;
+	}
+	// the partial buffer is written and reused as it is, the next bytes start a new buffer
+	const bool ok = hand_over_current() && wait_all() && acquire_buffer();
+	return ok == true ? 0 : -1;
+}
+
+inline bool UringFileBuf::close()
+{
+	if (m_fd < 0)
+	{
+		return m_failed == false;
+	}
+	sync();
+	setp(nullptr, nullptr);
+	if (::close(m_fd) != 0)
+	{
+		m_failed = true;
+	}
+	m_fd = -1;
+	m_ring.reset();
+	return m_failed == false;
+}
+
+// queues the bytes of the current buffer for the file
+inline bool UringFileBuf::hand_over_current()
+{
+	Buffer & buffer = m_buffers[m_current];
+	const std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+	setp(nullptr, nullptr);
+	if (size == 0)
+	{
+		buffer.state = State::Free;
+		return true;
+	}
+	buffer.iov.iov_base = buffer.bytes.get();
+	buffer.iov.iov_len = size;
+	buffer.offset = m_offset;
+	m_offset += size;
+	if (m_ring != nullptr)
+	{
+		buffer.state = State::InFlight;
+		if (m_ring->submit_writev(m_fd, &buffer.iov, buffer.offset, m_current) == false)
+		{
+			m_failed = true;
+			buffer.state = State::Free;
+			return false;
+		}
+		++m_inFlight;
+	}
+	else
+	{
+		buffer.state = State::Filled;
+	}
+	return true;
+}
+
+// makes the next buffer in turn current, waits for it or writes the batch if it is still taken
+inline bool UringFileBuf::acquire_buffer()
+{
+	Buffer & next = m_buffers[m_next];
+	if (next.state == State::Filled && write_filled() == false)
+	{
+		return false;
+	}
+	while (next.state == State::InFlight)
+	{
+		if (complete_one() == false)
+		{
+			return false;
+		}
+	}
+	set_current(m_next);
+	m_next = (m_next + 1) % kBuffers;
+	return true;
+}
+
+inline bool UringFileBuf::complete_one()
+{
+	std::uint64_t index = 0;
+	int result = 0;
+	if (m_ring->wait(index, result) == false)
+	{
+		m_failed = true;
+		return false;
+	}
+	--m_inFlight;
+	Buffer & buffer = m_buffers[index];
+	buffer.state = State::Free;
+	// a short write finishes synchronously, it does not happen with regular files in practice;
+	// pwrite writing nothing sets no errno, it is a failure of its own and not retried
+	std::size_t done = result > 0 ? static_cast<std::size_t>(result) : 0;
+	while (result >= 0 && done < buffer.iov.iov_len)
+	{
+		const ssize_t n = ::pwrite(m_fd, static_cast<char *>(buffer.iov.iov_base) + done, buffer.iov.iov_len - done, static_cast<off_t>(buffer.offset + done));
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			result = -1;
+			break;
+		}
+		done += static_cast<std::size_t>(n);
+	}
+	if (result < 0)
+	{
+		m_failed = true;
+		return false;
+	}
+	return true;
+}
+
+// one pwritev for all filled buffers, they are contiguous in the file because they are filled round-robin
+inline bool UringFileBuf::write_filled()
+{
+	iovec iov[kBuffers];
+	int count = 0;
+	std::uint64_t offset = 0;
+	for (std::size_t i = 0; i < kBuffers; ++i)
+	{
+		Buffer & buffer = m_buffers[(m_next + i) % kBuffers];
+		if (buffer.state == State::Filled)
+		{
+			if (count == 0)
+			{
+				offset = buffer.offset;
+			}
+			iov[count++] = buffer.iov;
+			buffer.state = State::Free;
+		}
+	}
+	int first = 0;
+	while (first < count)
+	{
+		const ssize_t n = ::pwritev(m_fd, iov + first, count - first, static_cast<off_t>(offset));
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		// nothing written is a short write, retrying it would not move
+		if (n <= 0)
+		{
+			m_failed = true;
+			return false;
+		}
+		offset += static_cast<std::uint64_t>(n);
+		std::size_t left = static_cast<std::size_t>(n);
+		while (first < count && left >= iov[first].iov_len)
+		{
+			left -= iov[first].iov_len;
+			++first;
+		}
+		if (first < count)
+		{
+			iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + left;
+			iov[first].iov_len -= left;
+		}
+	}
+	return true;
+}
+
+inline bool UringFileBuf::wait_all()
+{
+	if (m_ring == nullptr)
+	{
+		return write_filled();
+	}
+	while (m_inFlight > 0)
+	{
+		if (complete_one() == false)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
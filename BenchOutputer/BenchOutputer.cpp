@@ -0,0 +1,236 @@
+// Throughput of Outputer against the number of registered streams.
+// Results are printed as JSON, see bench_suite.hpp for the options.
+// Linux: g++ -std=c++17 -O2 -pthread BenchOutputer.cpp -o BenchOutputer
+#include "../bench_suite.hpp"
+#include "../AbstractStorageTest/ConcurrentOutputer.hpp"
+#include "../AbstractStorageTest/MappedFileSink.hpp"
+#include "../AbstractStorageTest/Outputer.hpp"
+#include "../AbstractStorageTest/UringFileSink.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using bench::Suite;
+using bench::do_not_optimize;
+
+constexpr std::size_t kRecords = 256;
+constexpr std::size_t kMaxSinks = 8;
+constexpr std::size_t kMaxThreads = 8;
+constexpr std::size_t kThreadRecords = 4096;
+constexpr std::size_t kFileRecords = 4096; // about 150 KiB, several buffers of every file stream
+
+// accepts and drops everything, like /dev/null without the syscall
+class NullBuffer : public std::streambuf
+{
+public:
+	NullBuffer() { setp(m_bytes, m_bytes + sizeof(m_bytes)); }
+	std::size_t written() const { return m_written + static_cast<std::size_t>(pptr() - pbase()); }
+protected:
+	int_type overflow(int_type ch) override
+	{
+		m_written += static_cast<std::size_t>(pptr() - pbase()) + 1;
+		setp(m_bytes, m_bytes + sizeof(m_bytes));
+		return traits_type::not_eof(ch);
+	}
+private:
+	char m_bytes[4096];
+	std::size_t m_written = 0;
+};
+
+class NullStream : public std::ostream
+{
+public:
+	NullStream() : std::ostream(&m_buffer) {}
+	std::size_t written() const { return m_buffer.written(); }
+private:
+	NullBuffer m_buffer;
+};
+
+// one record is a line of a typical log: text, integers and a floating-point value
+void write_record(Outputer& out, std::size_t i)
+{
+	out << "request " << i << " took " << 0.25 * static_cast<double>(i) << " ms, status " << 200 << "\n";
+}
+
+void bench_fan_out(Suite& suite, Outputer::Mode mode, const std::string& name)
+{
+	for (std::size_t sinks = 1; sinks <= kMaxSinks; sinks *= 2)
+	{
+		Outputer out(mode);
+		for (std::size_t i = 0; i < sinks; ++i)
+		{
+			out.add_stream(std::make_unique<NullStream>());
+		}
+		suite.measure("fan_out/" + name + "/sinks=" + std::to_string(sinks), kRecords, [&]() {
+			for (std::size_t i = 0; i < kRecords; ++i)
+			{
+				write_record(out, i);
+			}
+			do_not_optimize(out);
+		});
+	}
+}
+
+// the cost seen by the producer, the writer threads are drained before every round
+void bench_background(Suite& suite, Outputer::Mode mode, const std::string& name)
+{
+	for (std::size_t sinks = 1; sinks <= kMaxSinks; sinks *= 2)
+	{
+		Outputer out(mode);
+		for (std::size_t i = 0; i < sinks; ++i)
+		{
+			out.add_stream(std::make_unique<NullStream>());
+		}
+		suite.measure("fan_out/" + name + "/sinks=" + std::to_string(sinks), kRecords, [&]() { out.flush(); }, [&]() {
+			for (std::size_t i = 0; i < kRecords; ++i)
+			{
+				write_record(out, i);
+			}
+			do_not_optimize(out);
+		});
+	}
+}
+
+// every thread writes kThreadRecords records, ns per record falls as long as the producers scale;
+// flush drains what the variant still holds, inside the round, so every variant pays for all its records
+template<typename Write, typename Flush>
+void bench_threads(Suite& suite, const std::string& name, Write write, Flush flush)
+{
+	for (std::size_t threads = 1; threads <= kMaxThreads; threads *= 2)
+	{
+		suite.measure("threads/" + name + "/threads=" + std::to_string(threads), threads * kThreadRecords, [&]() {
+			std::vector<std::thread> producers;
+			for (std::size_t t = 0; t < threads; ++t)
+			{
+				producers.emplace_back([&]() {
+					for (std::size_t i = 0; i < kThreadRecords; ++i)
+					{
+						write(i);
+					}
+				});
+			}
+			for (auto& producer : producers)
+			{
+				producer.join();
+			}
+			flush();
+		});
+	}
+}
+
+void bench_concurrent(Suite& suite)
+{
+	{
+		Outputer out(Outputer::Mode::FormatOnce);
+		out.add_stream(std::make_unique<NullStream>());
+		std::mutex mutex;
+		bench_threads(suite, "mutex", [&](std::size_t i) {
+			std::lock_guard<std::mutex> lock(mutex);
+			write_record(out, i);
+		}, [&]() { out.flush(); });
+	}
+	{
+		ConcurrentOutputer out;
+		out.add_stream(std::make_unique<NullStream>());
+		bench_threads(suite, "concurrent", [&](std::size_t i) {
+			out << "request " << i << " took " << 0.25 * static_cast<double>(i) << " ms, status " << 200 << "\n";
+		}, [&]() { out.flush(); });
+	}
+	// the producers of ConcurrentOutputer share no lock, it should pull ahead as the threads are added;
+	// the speedup only shows with as many hardware threads, see the context
+	for (std::size_t threads = 1; threads <= kMaxThreads; threads *= 2)
+	{
+		const std::string suffix = "/threads=" + std::to_string(threads);
+		suite.compare("threads/mutex" + suffix, "threads/concurrent" + suffix);
+	}
+}
+
+// formatting alone: the values of a record appended to a buffer through an ostream and through FastFormat
+void bench_format(Suite& suite)
+{
+	FormatBuffer buffer;
+	std::ostream stream(&buffer);
+	suite.measure("format/ostream", kRecords, [&]() {
+		for (std::size_t i = 0; i < kRecords; ++i)
+		{
+			buffer.clear();
+			stream << "request " << i << " took " << 0.25 * static_cast<double>(i) << " ms, status " << 200 << "\n";
+		}
+		do_not_optimize(buffer);
+	});
+	suite.measure("format/to_chars", kRecords, [&]() {
+		for (std::size_t i = 0; i < kRecords; ++i)
+		{
+			buffer.clear();
+			FastFormat::append(buffer, "request ");
+			FastFormat::append(buffer, i);
+			FastFormat::append(buffer, " took ");
+			FastFormat::append(buffer, 0.25 * static_cast<double>(i));
+			FastFormat::append(buffer, " ms, status ");
+			FastFormat::append(buffer, 200);
+			FastFormat::append(buffer, "\n");
+		}
+		do_not_optimize(buffer);
+	});
+}
+
+// real files, the stream is flushed at the end of every round
+template<typename Make>
+void bench_file(Suite& suite, const std::string& name, Make make)
+{
+	const std::string path = (std::filesystem::temp_directory_path() / "BenchOutputer.txt").string();
+	{
+		Outputer out(Outputer::Mode::FormatOnce);
+		out.add_stream(make(path));
+		suite.measure("file/" + name, kFileRecords, [&]() {
+			for (std::size_t i = 0; i < kFileRecords; ++i)
+			{
+				write_record(out, i);
+			}
+			out.flush();
+		});
+	}
+	std::filesystem::remove(path);
+}
+
+void run_all(Suite& suite)
+{
+	bench_format(suite);
+	bench_fan_out(suite, Outputer::Mode::PerStream, "per_stream");
+	bench_fan_out(suite, Outputer::Mode::FormatOnce, "format_once");
+	bench_fan_out(suite, Outputer::Mode::Binary, "binary");
+	bench_background(suite, Outputer::Mode::Async, "async");
+	bench_background(suite, Outputer::Mode::Parallel, "parallel");
+	bench_concurrent(suite);
+
+	bench_file(suite, "std::ofstream", [](const std::string& path) { return std::make_unique<std::ofstream>(path, std::ios::trunc); });
+#if defined(__linux__)
+#if __has_include(<linux/io_uring.h>)
+	bench_file(suite, "uring", [](const std::string& path) { return std::make_unique<UringFileStream>(path); });
+#endif
+	bench_file(suite, "pwritev", [](const std::string& path) { return std::make_unique<UringFileStream>(path, false, UringFileBuf::Backend::Pwritev); });
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+	bench_file(suite, "mmap", [](const std::string& path) { return std::make_unique<MappedFileStream>(path); });
+#endif
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	return bench::run_main(argc, argv, [](Suite& suite) {
+		suite.add_context("records", kRecords);
+		suite.add_context("hardware_threads", std::thread::hardware_concurrency());
+		run_all(suite);
+	});
+}
@@ -0,0 +1,298 @@
+// Micro-benchmarks of uniform_ptr against raw pointers, std::unique_ptr and std::shared_ptr.
+// Results are printed as JSON, see bench_suite.hpp for the options.
+// Linux: g++ -std=c++17 -O2 -pthread BenchUniformPtr.cpp -o BenchUniformPtr
+#include "../atomic_uniform_ptr.hpp"
+#include "../bench_suite.hpp"
+#include "../uniform_ptr.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using bench::Suite;
+using bench::do_not_optimize;
+
+constexpr std::size_t kHandles = 1024;
+constexpr std::size_t kMaxThreads = 4;
+constexpr std::size_t kThreadReads = 16 * kHandles; // amortizes the start of the threads
+
+// used as base class
+struct Value {
+	virtual ~Value() = default;
+	virtual int get() const = 0;
+};
+
+// Value is the second base, so upcasts adjust the pointer
+struct Tag {
+	virtual ~Tag() = default;
+	int m_tag = 0;
+};
+
+struct Leaf final : Tag, Value {
+	explicit Leaf(int a_value) : m_value(a_value) {}
+	int get() const override { return m_value; }
+	int m_value;
+};
+
+// counts its owners itself, as std::shared_ptr counts them for Leaf
+struct CountedLeaf final : Value {
+	explicit CountedLeaf(int a_value) : m_value(a_value) {}
+	int get() const override { return m_value; }
+
+	friend void add_ref(CountedLeaf* a_obj) { a_obj->m_refs.fetch_add(1, std::memory_order_relaxed); }
+	friend void release(CountedLeaf* a_obj)
+	{
+		if (a_obj->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete a_obj;
+		}
+	}
+
+	int m_value;
+	std::atomic<long> m_refs{ 0 };
+};
+
+// get() and operator-> of an existing handle
+template<typename Ptr>
+void bench_access(Suite& suite, const std::string& name, const Ptr& p)
+{
+	suite.measure("get/" + name, kHandles, [&]() {
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			do_not_optimize(p);
+			const auto raw = &*p;
+			do_not_optimize(raw);
+		}
+	});
+	suite.measure("arrow/" + name, kHandles, [&]() {
+		int sum = 0;
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			do_not_optimize(p);
+			sum += p->get();
+		}
+		do_not_optimize(sum);
+	});
+}
+
+// construction of kHandles handles by make(), then their destruction
+template<typename Make>
+void bench_construct_destroy(Suite& suite, const std::string& name, Make make)
+{
+	using Ptr = decltype(make());
+	std::vector<Ptr> ptrs;
+	ptrs.reserve(kHandles);
+	suite.measure("construct/" + name, kHandles, [&]() { ptrs.clear(); }, [&]() {
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			ptrs.push_back(make());
+		}
+	});
+	suite.measure("destroy/" + name, kHandles, [&]() {
+		ptrs.clear();
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			ptrs.push_back(make());
+		}
+	}, [&]() { ptrs.clear(); });
+}
+
+// copy and move construction of To from an existing From, converting when the types differ
+template<typename To, typename From>
+void bench_copy_move(Suite& suite, const std::string& name, const From& source)
+{
+	std::vector<To> copies;
+	copies.reserve(kHandles);
+	suite.measure("copy/" + name, kHandles, [&]() { copies.clear(); }, [&]() {
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			copies.emplace_back(source);
+		}
+	});
+
+	std::vector<From> sources(kHandles);
+	suite.measure("move/" + name, kHandles, [&]() {
+		copies.clear();
+		std::fill(sources.begin(), sources.end(), source);
+	}, [&]() {
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			copies.emplace_back(std::move(sources[i]));
+		}
+	});
+}
+
+// sums values through a vector of handles
+template<typename Ptr, typename Make>
+void bench_iterate(Suite& suite, const std::string& name, Make make)
+{
+	std::vector<Ptr> ptrs;
+	for (std::size_t i = 0; i < kHandles; ++i)
+	{
+		ptrs.push_back(make(i));
+	}
+	suite.measure("iterate/" + name, kHandles, [&]() {
+		int sum = 0;
+		for (const auto& p : ptrs)
+		{
+			sum += p->get();
+		}
+		do_not_optimize(sum);
+	});
+}
+
+// copy-heavy workloads, compare the reference counting policies
+template<typename Ptr>
+void bench_copy_heavy(Suite& suite, const std::string& name, const Ptr& a, const Ptr& b)
+{
+	std::vector<Ptr> copies;
+	copies.reserve(kHandles);
+	suite.measure("copy_heavy/to_vector/" + name, kHandles, [&]() {
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			copies.push_back(a);
+		}
+		do_not_optimize(copies.back());
+		copies.clear();
+	});
+
+	std::vector<Ptr> slots(kHandles);
+	for (std::size_t i = 0; i < kHandles; ++i)
+	{
+		slots[i] = i % 2 == 0 ? a : b;
+	}
+	std::size_t shift = 0;
+	suite.measure("copy_heavy/assign/" + name, kHandles, [&]() {
+		++shift;
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			slots[i] = slots[(i * 7 + shift) % kHandles];
+		}
+		do_not_optimize(slots.front());
+	});
+}
+
+// reader threads taking the current handle of a shared configuration, and the writer replacing it
+template<typename Load, typename Store>
+void bench_hot_swap(Suite& suite, const std::string& name, Load load, Store store)
+{
+	for (std::size_t threads = 1; threads <= kMaxThreads; threads *= 2)
+	{
+		suite.measure("hot_swap/load/" + name + "/threads=" + std::to_string(threads), threads * kThreadReads, [&]() {
+			std::vector<std::thread> readers;
+			for (std::size_t t = 0; t < threads; ++t)
+			{
+				readers.emplace_back([&]() {
+					int sum = 0;
+					for (std::size_t i = 0; i < kThreadReads; ++i)
+					{
+						sum += load()->get();
+					}
+					do_not_optimize(sum);
+				});
+			}
+			for (auto& reader : readers)
+			{
+				reader.join();
+			}
+		});
+	}
+	const akt::uniform_ptr<Value> next = akt::make_uniform<Value, Leaf>(2);
+	suite.measure("hot_swap/store/" + name, kHandles, [&]() {
+		for (std::size_t i = 0; i < kHandles; ++i)
+		{
+			store(next);
+		}
+	});
+}
+
+void bench_hot_swap_all(Suite& suite)
+{
+	{
+		akt::uniform_ptr<Value> config = akt::make_uniform<Value, Leaf>(1);
+		std::mutex mutex;
+		bench_hot_swap(suite, "mutex", [&]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return config;
+		}, [&](const akt::uniform_ptr<Value>& next) {
+			std::lock_guard<std::mutex> lock(mutex);
+			config = next;
+		});
+	}
+	{
+		akt::atomic_uniform_ptr<Value> config{ akt::make_uniform<Value, Leaf>(1) };
+		bench_hot_swap(suite, "atomic_uniform_ptr", [&]() { return config.load(); }, [&](const akt::uniform_ptr<Value>& next) { config.store(next); });
+	}
+}
+
+void run_all(Suite& suite)
+{
+	Leaf leaf{ 1 };
+	Value* const raw = &leaf;
+	const std::unique_ptr<Value> unique = std::make_unique<Leaf>(1);
+	const std::shared_ptr<Leaf> shared = std::make_shared<Leaf>(1);
+	const akt::uniform_ptr<Value> uniform_raw{ &leaf };
+	const akt::uniform_ptr<Value> uniform_owned = akt::make_uniform<Value, Leaf>(1);
+
+	bench_access(suite, "raw", raw);
+	bench_access(suite, "std::unique_ptr", unique);
+	bench_access(suite, "std::shared_ptr", shared);
+	bench_access(suite, "uniform_ptr/raw_pointer", uniform_raw);
+	bench_access(suite, "uniform_ptr/owned", uniform_owned);
+
+	using inline_ptr = akt::uniform_ptr<Value, akt::inline_policy<sizeof(Leaf), alignof(Leaf)>>;
+	bench_construct_destroy(suite, "std::make_unique", []() { return std::make_unique<Leaf>(1); });
+	bench_construct_destroy(suite, "std::make_shared", []() { return std::make_shared<Leaf>(1); });
+	bench_construct_destroy(suite, "uniform_ptr/raw_pointer", [&]() { return akt::uniform_ptr<Value>(&leaf); });
+	bench_construct_destroy(suite, "uniform_ptr/value_copy", [&]() { return akt::uniform_ptr<Value>(leaf); });
+	bench_construct_destroy(suite, "uniform_ptr/value_move", []() { return akt::uniform_ptr<Value>(Leaf{ 1 }); });
+	bench_construct_destroy(suite, "uniform_ptr/make_uniform", []() { return akt::make_uniform<Value, Leaf>(1); });
+	bench_construct_destroy(suite, "uniform_ptr/shared_ptr", [&]() { return akt::uniform_ptr<Value>(shared); });
+	bench_construct_destroy(suite, "uniform_ptr/unique_ptr", []() { return akt::uniform_ptr<Value>(std::make_unique<Leaf>(1)); });
+	bench_construct_destroy(suite, "uniform_ptr/make_shared", []() { return akt::uniform_ptr<Value>(std::make_shared<Leaf>(1)); });
+	bench_construct_destroy(suite, "uniform_ptr/intrusive", []() { return akt::uniform_ptr<Value>(akt::intrusive, new CountedLeaf(1)); });
+	bench_construct_destroy(suite, "uniform_ptr/inline_value", []() { return inline_ptr(Leaf{ 1 }); });
+	bench_construct_destroy(suite, "uniform_unique_ptr/value_move", []() { return akt::uniform_unique_ptr<Value>(Leaf{ 1 }); });
+
+	bench_copy_move<std::shared_ptr<Leaf>>(suite, "std::shared_ptr", shared);
+	bench_copy_move<std::shared_ptr<Value>>(suite, "std::shared_ptr/converting", shared);
+	bench_copy_move<akt::uniform_ptr<Value>>(suite, "uniform_ptr/raw_pointer", uniform_raw);
+	bench_copy_move<akt::uniform_ptr<Value>>(suite, "uniform_ptr/owned", uniform_owned);
+	bench_copy_move<akt::uniform_ptr<Value>>(suite, "uniform_ptr/converting", akt::make_uniform<Leaf>(1));
+	bench_copy_move<akt::uniform_ptr<Value>>(suite, "uniform_ptr/intrusive", akt::uniform_ptr<Value>(akt::intrusive, new CountedLeaf(1)));
+	bench_copy_move<inline_ptr>(suite, "uniform_ptr/inline_value", inline_ptr(Leaf{ 1 }));
+
+	std::vector<Leaf> leaves;
+	leaves.reserve(kHandles);
+	for (std::size_t i = 0; i < kHandles; ++i)
+	{
+		leaves.emplace_back(static_cast<int>(i));
+	}
+	bench_iterate<Value*>(suite, "raw", [&](std::size_t i) { return &leaves[i]; });
+	bench_iterate<std::unique_ptr<Value>>(suite, "std::unique_ptr", [](std::size_t i) { return std::make_unique<Leaf>(static_cast<int>(i)); });
+	bench_iterate<std::shared_ptr<Value>>(suite, "std::shared_ptr", [](std::size_t i) { return std::make_shared<Leaf>(static_cast<int>(i)); });
+	bench_iterate<akt::uniform_ptr<Value>>(suite, "uniform_ptr/raw_pointer", [&](std::size_t i) { return akt::uniform_ptr<Value>(&leaves[i]); });
+	bench_iterate<akt::uniform_ptr<Value>>(suite, "uniform_ptr/owned", [](std::size_t i) { return akt::make_uniform<Value, Leaf>(static_cast<int>(i)); });
+
+	bench_copy_heavy(suite, "std::shared_ptr", std::make_shared<int>(1), std::make_shared<int>(2));
+	bench_copy_heavy(suite, "uniform_ptr", akt::uniform_ptr<int>{ 1 }, akt::uniform_ptr<int>{ 2 });
+	bench_copy_heavy(suite, "uniform_ptr/single_thread_rc", akt::uniform_ptr<int, akt::single_thread_rc>{ 1 }, akt::uniform_ptr<int, akt::single_thread_rc>{ 2 });
+
+	bench_hot_swap_all(suite);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	return bench::run_main(argc, argv, [](Suite& suite) {
+		suite.add_context("handles", kHandles);
+		run_all(suite);
+	});
+}
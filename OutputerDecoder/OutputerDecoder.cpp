@@ -0,0 +1,43 @@
+// Turns the records written by Outputer in Binary mode back into text.
+// usage: OutputerDecoder <binary file> [text file], the text goes to the standard output by default
+// Linux: g++ -std=c++17 -O2 OutputerDecoder.cpp -o OutputerDecoder
+#include "../AbstractStorageTest/BinaryRecord.hpp"
+
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argc > 3)
+	{
+		std::cerr << "usage: OutputerDecoder <binary file> [text file]" << std::endl;
+		return 2;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	if (in.is_open() != true)
+	{
+		std::cerr << "cannot open " << argv[1] << std::endl;
+		return 1;
+	}
+	std::ofstream file;
+	if (argc == 3)
+	{
+		file.open(argv[2], std::ios::binary | std::ios::trunc);
+		if (file.is_open() != true)
+		{
+			std::cerr << "cannot open " << argv[2] << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = argc == 3 ? file : std::cout;
+
+	BinaryDecoder decoder;
+	if (decoder.decode(in, out) != true)
+	{
+		out.flush();
+		std::cerr << argv[1] << ": " << decoder.error() << std::endl;
+		return 1;
+	}
+	out.flush();
+	return out.fail() == true ? 1 : 0;
+}
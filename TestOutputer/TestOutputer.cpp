@@ -0,0 +1,1267 @@
+#define BOOST_TEST_MODULE TestOutputer
+#define OUTPUTER_SINK_METRICS
+
+#include <boost/test/included/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <locale>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../AbstractStorageTest/ConcurrentOutputer.hpp"
+#include "../AbstractStorageTest/MappedFileSink.hpp"
+#include "../AbstractStorageTest/Outputer.hpp"
+#include "../AbstractStorageTest/UringFileSink.hpp"
+
+// accepts a limited number of bytes, then fails every write
+class LimitedBuffer : public std::streambuf
+{
+public:
+	explicit LimitedBuffer(std::size_t a_limit) : m_limit(a_limit) {}
+	const std::string & str() const { return m_bytes; }
+protected:
+	std::streamsize xsputn(const char * s, std::streamsize n) override
+	{
+		const std::size_t count = std::min(static_cast<std::size_t>(n), m_limit - m_bytes.size());
+		m_bytes.append(s, count);
+		return static_cast<std::streamsize>(count);
+	}
+	int_type overflow(int_type ch) override
+	{
+		if (m_bytes.size() == m_limit || traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			return traits_type::eof();
+		}
+		m_bytes.push_back(traits_type::to_char_type(ch));
+		return ch;
+	}
+private:
+	std::size_t m_limit;
+	std::string m_bytes;
+};
+
+// holds the writing thread in the first write until open() is called
+class GateBuffer : public std::streambuf
+{
+public:
+	void open()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_open = true;
+		m_changed.notify_all();
+	}
+	void wait_entered()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_changed.wait(lock, [&]() { return m_entered; });
+	}
+	std::string str()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_bytes;
+	}
+protected:
+	std::streamsize xsputn(const char * s, std::streamsize n) override
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_entered = true;
+		m_changed.notify_all();
+		m_changed.wait(lock, [&]() { return m_open; });
+		m_bytes.append(s, static_cast<std::size_t>(n));
+		return n;
+	}
+	int_type overflow(int_type ch) override
+	{
+		const char c = traits_type::to_char_type(ch);
+		return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+	}
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+	bool m_entered = false;
+	bool m_open = false;
+	std::string m_bytes;
+};
+
+// sleeps in every write, a stand-in for a slow pipe or network file
+class SlowBuffer : public std::streambuf
+{
+public:
+	explicit SlowBuffer(std::chrono::microseconds a_delay) : m_delay(a_delay) {}
+	const std::string & str() const { return m_bytes; }
+protected:
+	std::streamsize xsputn(const char * s, std::streamsize n) override
+	{
+		std::this_thread::sleep_for(m_delay);
+		m_bytes.append(s, static_cast<std::size_t>(n));
+		return n;
+	}
+	int_type overflow(int_type ch) override
+	{
+		const char c = traits_type::to_char_type(ch);
+		return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+	}
+private:
+	std::chrono::microseconds m_delay;
+	std::string m_bytes;
+};
+
+// redirects std::cerr for the lifetime of the object
+class CerrCapture
+{
+public:
+	CerrCapture() : m_old(std::cerr.rdbuf(m_text.rdbuf())) {}
+	~CerrCapture() { std::cerr.rdbuf(m_old); }
+	std::string str() const { return m_text.str(); }
+private:
+	std::ostringstream m_text;
+	std::streambuf * m_old;
+};
+
+// waits up to ten seconds for the condition
+template <typename Condition>
+bool eventually(Condition a_condition)
+{
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (a_condition() == false)
+	{
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+// checks that every line "thread <t> line <i>" is intact and the lines of every thread are in order
+void check_lines(const std::string & a_text, int a_threads, int a_lines)
+{
+	std::istringstream lines(a_text);
+	std::vector<int> next(a_threads, 0);
+	std::string word1, word2;
+	int t = 0, i = 0;
+	int count = 0;
+	while (lines >> word1 >> t >> word2 >> i)
+	{
+		BOOST_REQUIRE(word1 == "thread" && word2 == "line" && t >= 0 && t < a_threads);
+		BOOST_CHECK_EQUAL(next[t], i);
+		next[t] = i + 1;
+		++count;
+	}
+	BOOST_CHECK_EQUAL(a_threads * a_lines, count);
+}
+
+// a file in the temporary directory, removed with the object; the names differ between concurrent test runs
+class TempFile
+{
+public:
+	explicit TempFile(const std::string & a_name)
+		: m_path((std::filesystem::temp_directory_path() / ("TestOutputer_" + run_id() + "_" + a_name)).string())
+	{
+		std::filesystem::remove(m_path);
+	}
+	~TempFile() { std::filesystem::remove(m_path); }
+	const std::string & path() const { return m_path; }
+	std::string read() const
+	{
+		std::ifstream file(m_path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+private:
+	static const std::string & run_id()
+	{
+		static const std::string id = std::to_string(std::random_device()());
+		return id;
+	}
+
+	std::string m_path;
+};
+
+template <typename T>
+void write_sample(T & out)
+{
+	out << "value " << 42 << ' ' << -7L << ' ' << 2.5 << ' ' << std::string("text") << '\n';
+}
+
+// the counters of the sink writing to a_stream
+SinkMetrics::Snapshot metrics_of(const void * a_stream)
+{
+	for (const auto & sink : SinkMetrics::snapshot_all())
+	{
+		if (sink.stream == a_stream)
+		{
+			return sink;
+		}
+	}
+	BOOST_FAIL("no metrics for the stream");
+	return SinkMetrics::Snapshot();
+}
+
+std::uint64_t latency_count(const SinkMetrics::Snapshot & a_sink)
+{
+	std::uint64_t count = 0;
+	for (const auto bucket : a_sink.latency)
+	{
+		count += bucket;
+	}
+	return count;
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_format_once_matches_per_stream)
+{
+	std::ostringstream expected;
+	write_sample(expected);
+
+	for (auto mode : { Outputer::Mode::PerStream, Outputer::Mode::FormatOnce })
+	{
+		std::ostringstream s1;
+		auto s2 = std::make_shared<std::ostringstream>();
+		Outputer out(mode);
+		out.add_stream(&s1);
+		out.add_stream(s2);
+		write_sample(out);
+		BOOST_CHECK_EQUAL(expected.str(), s1.str());
+		BOOST_CHECK_EQUAL(expected.str(), s2->str());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_format_once_manipulators)
+{
+	std::ostringstream s;
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(&s);
+	out << std::hex << 255 << ' ';
+	out.formatter() << std::setprecision(3);
+	out << 3.14159;
+	BOOST_CHECK_EQUAL("ff 3.14", s.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_format_once_long_value)
+{
+	const std::string text(10000, 'x');
+	std::ostringstream s;
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(&s);
+	out << text << 1;
+	BOOST_CHECK_EQUAL(text + "1", s.str());
+}
+
+// a type formatted by FastFormat through its own overload, and by ostream when the formatter is not plain
+struct Price
+{
+	long cents;
+};
+
+void fast_format(FormatBuffer & a_out, const Price & a_price)
+{
+	FastFormat::append(a_out, a_price.cents / 100);
+	a_out.append(".", 1);
+	FastFormat::append(a_out, static_cast<char>('0' + a_price.cents % 100 / 10));
+	FastFormat::append(a_out, static_cast<char>('0' + a_price.cents % 10));
+}
+
+std::ostream & operator<<(std::ostream & a_out, const Price & a_price)
+{
+	return a_out << a_price.cents / 100 << '.' << a_price.cents % 100 / 10 << a_price.cents % 10;
+}
+
+struct Opaque
+{
+};
+
+std::ostream & operator<<(std::ostream & a_out, const Opaque &)
+{
+	return a_out << "opaque";
+}
+
+// groups thousands, so that a value formatted by ostream differs from std::to_chars
+class Grouping : public std::numpunct<char>
+{
+protected:
+	std::string do_grouping() const override { return "\3"; }
+	char do_thousands_sep() const override { return ','; }
+};
+
+template <typename T>
+void check_fast_format(const T & a_val)
+{
+	std::ostringstream expected;
+	expected << a_val;
+	FormatBuffer buffer;
+	FastFormat::append(buffer, a_val);
+	BOOST_CHECK_EQUAL(expected.str(), std::string(buffer.data(), buffer.size()));
+}
+
+BOOST_AUTO_TEST_CASE(test_fast_format_matches_ostream)
+{
+	static_assert(FastFormat::supports<int>() && FastFormat::supports<std::string>() && FastFormat::supports<Price>(), "fast types");
+	static_assert(FastFormat::supports<Opaque>() == false && FastFormat::supports<wchar_t>() == false, "ostream types");
+
+	check_fast_format(true);
+	check_fast_format('c');
+	check_fast_format(static_cast<unsigned char>('u'));
+	check_fast_format(std::numeric_limits<short>::min());
+	check_fast_format(std::numeric_limits<int>::min());
+	check_fast_format(std::numeric_limits<long long>::min());
+	check_fast_format(std::numeric_limits<unsigned long long>::max());
+	for (double value : { 0.0, -0.0, 1.0, 0.1, 2.5, -1234.5678, 1e-5, 123456.0, 1234567.0, 1e300, 5e-324,
+		std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() })
+	{
+		check_fast_format(value);
+		check_fast_format(static_cast<float>(value));
+		check_fast_format(static_cast<long double>(value));
+	}
+	check_fast_format("literal");
+	check_fast_format(std::string(1000, 's'));
+	check_fast_format(std::string_view("view"));
+	check_fast_format(Price{ 12345 });
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_format_once_fast_path)
+{
+	std::ostringstream expected;
+	auto s = std::make_shared<std::ostringstream>();
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(s);
+	const auto write = [](auto & a_out) { a_out << "price " << Price{ 1999 } << ' ' << Opaque{} << ' ' << 1234567 << ' ' << 0.125 << '\n'; };
+	write(out);
+	write(expected);
+
+	// manipulators and locales turn the fast path off for as long as they are in effect
+	out << std::hex << 255 << std::dec << ' ' << std::setprecision(2) << 3.14159 << std::setprecision(6) << ' ';
+	expected << std::hex << 255 << std::dec << ' ' << std::setprecision(2) << 3.14159 << std::setprecision(6) << ' ';
+	out.formatter().imbue(std::locale(std::locale::classic(), new Grouping));
+	expected.imbue(std::locale(std::locale::classic(), new Grouping));
+	write(out);
+	write(expected);
+	out.formatter().imbue(std::locale::classic());
+	expected.imbue(std::locale::classic());
+	write(out);
+	write(expected);
+	BOOST_CHECK_EQUAL(expected.str(), s->str());
+	BOOST_CHECK(s->str().find("1,234,567") != std::string::npos);
+
+	// a null C string fails the sinks as it fails an ostream, and is reported
+	CerrCapture errors;
+	const char * null = nullptr;
+	out << null << 1;
+	expected << null << 1;
+	BOOST_CHECK_EQUAL(true, expected.fail());
+	BOOST_CHECK_EQUAL(expected.str(), s->str());
+	BOOST_CHECK_EQUAL("invalid stream\n", errors.str());
+	BOOST_CHECK_EQUAL(2u, metrics_of(s.get()).failures);
+
+	// the formatter is not left failed, the values after it are written
+	auto later = std::make_shared<std::ostringstream>();
+	out.add_stream(later);
+	out << 2 << ' ' << 0.5;
+	BOOST_CHECK_EQUAL(false, out.formatter().fail());
+	BOOST_CHECK_EQUAL("2 0.5", later->str());
+
+	std::ostringstream async;
+	{
+		Outputer asyncOut(Outputer::Mode::Async);
+		asyncOut.add_stream(&async);
+		asyncOut << "a" << null << "b" << 3 << '\n';
+	}
+	BOOST_CHECK_EQUAL("ab3\n", async.str());
+	BOOST_CHECK_EQUAL("invalid stream\ninvalid stream\n", errors.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_format_once_skips_failed_sink)
+{
+	CerrCapture errors;
+	LimitedBuffer limited(8);
+	std::ostream failing(&limited);
+	std::ostringstream healthy;
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(&failing);
+	out.add_stream(nullptr);
+	out.add_stream(&healthy);
+	out << "12345" << "67890" << "abc";
+	BOOST_CHECK_EQUAL("1234567890abc", healthy.str());
+	BOOST_CHECK_EQUAL("12345678", limited.str());
+
+	// reported once, when it happened
+	failing.clear();
+	out << "def";
+	BOOST_CHECK_EQUAL("12345678", limited.str());
+	BOOST_CHECK_EQUAL("failed to out value\ninvalid stream\n", errors.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_sink_metrics_format_once)
+{
+	CerrCapture errors;
+	LimitedBuffer limited(8);
+	std::ostream failing(&limited);
+	std::ostringstream healthy;
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(&failing);
+	out.add_stream(&healthy);
+	out << "12345" << "67890" << "abc";
+
+	const auto good = metrics_of(&healthy);
+	BOOST_CHECK_EQUAL(13u, good.bytes);
+	BOOST_CHECK_EQUAL(3u, good.records);
+	BOOST_CHECK_EQUAL(0u, good.failures);
+	BOOST_CHECK_EQUAL(3u, latency_count(good));
+
+	// the failed write and the one skipped after it
+	const auto bad = metrics_of(&failing);
+	BOOST_CHECK_EQUAL(5u, bad.bytes);
+	BOOST_CHECK_EQUAL(1u, bad.records);
+	BOOST_CHECK_EQUAL(2u, bad.failures);
+	BOOST_CHECK_EQUAL(2u, latency_count(bad));
+	BOOST_CHECK(bad.id < good.id);
+}
+
+BOOST_AUTO_TEST_CASE(test_sink_metrics_per_stream_and_async)
+{
+	CerrCapture errors;
+	std::ostringstream s;
+	std::ostream broken(nullptr);
+	// without a position, the bytes are counted as they pass to the streambuf
+	GateBuffer gate;
+	gate.open();
+	std::ostream unseekable(&gate);
+	unseekable << std::hex << std::showbase;
+	{
+		Outputer out;
+		out.add_stream(&s);
+		out.add_stream(&broken);
+		out.add_stream(&unseekable);
+		out << "value " << 42 << '\n';
+		const auto good = metrics_of(&s);
+		BOOST_CHECK_EQUAL(9u, good.bytes);
+		BOOST_CHECK_EQUAL(3u, good.records);
+		BOOST_CHECK_EQUAL(3u, metrics_of(&broken).failures);
+		BOOST_CHECK_EQUAL("value 0x2a\n", gate.str());
+		BOOST_CHECK_EQUAL(11u, metrics_of(&unseekable).bytes);
+	}
+	std::ostringstream async;
+	{
+		Outputer out(Outputer::Mode::Async);
+		out.add_stream(&async);
+		out << "first " << 1 << '\n' << "second " << 2 << '\n';
+		out.flush();
+		const auto sink = metrics_of(&async);
+		BOOST_CHECK_EQUAL(17u, sink.bytes);
+		BOOST_CHECK_EQUAL(2u, sink.records);
+	}
+	// dropped with their outputers
+	for (const auto & sink : SinkMetrics::snapshot_all())
+	{
+		BOOST_CHECK(sink.stream != &s && sink.stream != &async);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_sink_metrics_dump)
+{
+	SinkMetrics::Snapshot sink;
+	sink.id = 7;
+	sink.bytes = 120;
+	sink.records = 3;
+	sink.failures = 1;
+	sink.latency[8] = 2;
+	sink.latency[10] = 2;
+	std::ostringstream text;
+	SinkMetrics::dump(text, { sink }, 4);
+	BOOST_CHECK_EQUAL("sink_metrics dump=4 id=7 stream=0x0 bytes=120 records=3 failures=1 latency_ns=256:2,1024:2\n", text.str());
+
+	GateBuffer gate;
+	gate.open();
+	std::ostream dumped(&gate);
+	std::ostringstream s;
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(&s);
+	out << "abc";
+	SinkMetricsDumper dumper(dumped, std::chrono::milliseconds(5));
+	BOOST_CHECK(eventually([&]() { return gate.str().find(" bytes=3 records=1 failures=0 ") != std::string::npos; }));
+}
+
+// the text BinaryDecoder makes of a_binary, empty with an error message on failure
+std::string decode(const std::string & a_binary, std::string * a_error = nullptr)
+{
+	std::istringstream in(a_binary);
+	std::ostringstream out;
+	BinaryDecoder decoder;
+	if (decoder.decode(in, out) == false)
+	{
+		if (a_error != nullptr)
+		{
+			*a_error = decoder.error();
+		}
+		return std::string();
+	}
+	return out.str();
+}
+
+// a value without a binary form, written as text
+struct Point
+{
+	int x;
+	int y;
+};
+
+std::ostream & operator<<(std::ostream & a_out, const Point & a_point)
+{
+	return a_out << '(' << a_point.x << ", " << a_point.y << ')';
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_binary_round_trip)
+{
+	std::ostringstream expected;
+	auto binary = std::make_shared<std::ostringstream>();
+	{
+		Outputer text(Outputer::Mode::PerStream);
+		text.add_stream(&expected);
+		Outputer out(Outputer::Mode::Binary);
+		out.add_stream(binary);
+		char array[16] = "array";
+		const char * pointer = "pointer";
+		for (int i = 0; i < 3; ++i)
+		{
+			write_sample(text);
+			write_sample(out);
+			text << true << 'c' << static_cast<unsigned char>('u') << static_cast<short>(-3) << 70000u << 1ull << 0.5f << 1.25L << std::string_view("view") << array << pointer << Point{ i, -i } << "\n";
+			out << true << 'c' << static_cast<unsigned char>('u') << static_cast<short>(-3) << 70000u << 1ull << 0.5f << 1.25L << std::string_view("view") << array << pointer << Point{ i, -i } << "\n";
+		}
+	}
+	BOOST_CHECK_EQUAL(expected.str(), decode(binary->str()));
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_binary_literals)
+{
+	auto first = std::make_shared<std::ostringstream>();
+	auto late = std::make_shared<std::ostringstream>();
+	Outputer out(Outputer::Mode::Binary);
+	out.add_stream(first);
+	out << "repeated literal ";
+	const std::size_t once = first->str().size();
+	out << "repeated literal ";
+	// the second time only the ID is written
+	BOOST_CHECK_EQUAL(1 + sizeof(void *), first->str().size() - once);
+
+	// a stream added later gets the definitions before it
+	out.add_stream(late);
+	out << "repeated literal " << 1;
+	BOOST_CHECK_EQUAL("repeated literal repeated literal repeated literal 1", decode(first->str()));
+	BOOST_CHECK_EQUAL("repeated literal 1", decode(late->str()));
+
+	// a constant array at the same address with other contents is defined again
+	for (int i = 0; i < 2; ++i)
+	{
+		const char name[] = { static_cast<char>('a' + i), '\0' };
+		out << name;
+	}
+	BOOST_CHECK_EQUAL("repeated literal 1ab", decode(late->str()));
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_binary_literal_limit)
+{
+	// more constant arrays than the table keeps, each at its own address
+	static char storage[BinaryEncoder::kMaxLiterals + 8][8];
+	const auto & names = storage;
+	std::string expected;
+	for (std::size_t i = 0; i < std::size(storage); ++i)
+	{
+		std::snprintf(storage[i], sizeof(storage[i]), "%zu,", i);
+		expected += storage[i];
+	}
+	std::ostringstream binary;
+	{
+		Outputer out(Outputer::Mode::Binary);
+		out.add_stream(&binary);
+		for (int round = 0; round < 2; ++round)
+		{
+			for (const auto & name : names)
+			{
+				out << name;
+			}
+		}
+	}
+	std::string error;
+	BOOST_CHECK(expected + expected == decode(binary.str(), &error));
+	BOOST_CHECK_EQUAL("", error);
+
+	// a stream that defines more than a writer keeps is not read
+	std::stringbuf records;
+	BinaryEncoder::header(records);
+	for (std::size_t i = 0; i <= BinaryEncoder::kMaxLiterals; ++i)
+	{
+		BinaryEncoder::literal_def(records, i, "x", 1);
+	}
+	BOOST_CHECK_EQUAL("", decode(records.str(), &error));
+	BOOST_CHECK_EQUAL("more literals defined than a writer keeps", error);
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_binary_decoder_errors)
+{
+	std::string error;
+	BOOST_CHECK_EQUAL("", decode("", &error));
+	BOOST_CHECK_EQUAL("empty input", error);
+	BOOST_CHECK_EQUAL("", decode("plain text", &error));
+	BOOST_CHECK_EQUAL("not a binary Outputer stream", error);
+
+	std::ostringstream binary;
+	{
+		Outputer out(Outputer::Mode::Binary);
+		out.add_stream(&binary);
+		out << 12345 << "literal";
+	}
+	const std::string records = binary.str();
+	BOOST_CHECK_EQUAL("12345literal", decode(records));
+	BOOST_CHECK_EQUAL("", decode(records.substr(0, records.size() - 1), &error));
+	BOOST_CHECK_EQUAL("truncated record", error);
+	BOOST_CHECK_EQUAL("", decode(records + "\x7f", &error));
+	BOOST_CHECK_EQUAL("unknown record tag 127", error);
+
+	// a corrupt length is not allocated up front, the record ends with the input
+	std::ostringstream header;
+	{
+		Outputer out(Outputer::Mode::Binary);
+		out.add_stream(&header);
+	}
+	const std::uint32_t corrupt = 0xFFFFFFF0u;
+	const std::string longString = header.str() + static_cast<char>(RecordTag::String)
+		+ std::string(reinterpret_cast<const char *>(&corrupt), sizeof(corrupt)) + "abc";
+	BOOST_CHECK_EQUAL("", decode(longString, &error));
+	BOOST_CHECK_EQUAL("truncated record", error);
+
+	// a second header, from a stream opened for appending, starts the literals over
+	BOOST_CHECK_EQUAL("12345literal12345literal", decode(records + records));
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_lines)
+{
+	std::ostringstream s1;
+	auto s2 = std::make_shared<std::ostringstream>();
+	Outputer out(Outputer::Mode::Async);
+	out.add_stream(&s1);
+	out.add_stream(s2);
+	out << "first " << 1 << "\n" << "second " << 2.5 << "\n" << "unfinished";
+	out.flush();
+	BOOST_CHECK_EQUAL("first 1\nsecond 2.5\nunfinished", s1.str());
+	BOOST_CHECK_EQUAL(s1.str(), s2->str());
+	BOOST_CHECK_EQUAL(3u, out.writer()->written());
+	BOOST_CHECK_EQUAL(0u, out.writer()->queue_depth());
+	BOOST_CHECK_EQUAL(0u, out.writer()->dropped());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_producers)
+{
+	constexpr int kThreads = 4;
+	constexpr int kLines = 2000;
+	std::ostringstream s;
+	auto writer = std::make_shared<AsyncWriter>(64);
+	writer->add_stream(&s);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < kThreads; ++t)
+	{
+		threads.emplace_back([writer, t]() {
+			Outputer out(writer);
+			for (int i = 0; i < kLines; ++i)
+			{
+				out << "thread " << t << " line " << i << "\n";
+			}
+		});
+	}
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+	writer->flush();
+	BOOST_CHECK_EQUAL(static_cast<std::size_t>(kThreads * kLines), writer->written());
+
+	check_lines(s.str(), kThreads, kLines);
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_drop)
+{
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto writer = std::make_shared<AsyncWriter>(4, AsyncWriter::Overflow::Drop);
+	writer->add_stream(&slow);
+	Outputer out(writer);
+
+	// the writer takes the first line and waits in the stream, four more fit the ring
+	out << "0\n";
+	gate.wait_entered();
+	for (int i = 1; i < 10; ++i)
+	{
+		out << i << "\n";
+	}
+	BOOST_CHECK_EQUAL(4u, writer->queue_depth());
+	BOOST_CHECK_EQUAL(5u, writer->dropped());
+
+	gate.open();
+	out.flush();
+	BOOST_CHECK_EQUAL("0\n1\n2\n3\n4\n", gate.str());
+	BOOST_CHECK_EQUAL(5u, writer->written());
+	BOOST_CHECK_EQUAL(0u, writer->queue_depth());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_shutdown)
+{
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto writer = std::make_shared<AsyncWriter>(16);
+	writer->add_stream(&slow);
+	{
+		Outputer out(writer);
+		out << "a\n";
+		gate.wait_entered();
+		out << "b\n" << "c";
+	}
+	gate.open();
+
+	// what was queued is written, later records are refused
+	writer->shutdown();
+	BOOST_CHECK_EQUAL("a\nb\nc", gate.str());
+	std::string late = "late\n";
+	BOOST_CHECK_EQUAL(false, writer->push(late));
+	BOOST_CHECK_EQUAL(1u, writer->dropped());
+	writer->flush();
+}
+
+#ifdef __cpp_impl_coroutine
+// a coroutine that starts at once and frees itself when it is done
+struct DetachedTask
+{
+	struct promise_type
+	{
+		DetachedTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+DetachedTask write_lines(Outputer & a_out, CoroutineExecutor * a_executor, int a_lines, std::atomic<int> & a_written)
+{
+	for (int i = 0; i < a_lines; ++i)
+	{
+		// a dropped line ends the coroutine early, the callers wait for all of them
+		if (co_await a_out.async_write("line ", a_executor) == false)
+		{
+			co_return;
+		}
+		co_await a_out.async_write(i, a_executor);
+		co_await a_out.async_write('\n', a_executor);
+		++a_written;
+	}
+	co_await a_out.async_write("end", a_executor);
+	co_await a_out.async_flush(a_executor);
+	++a_written;
+}
+
+std::string expected_lines(int a_lines)
+{
+	std::string text;
+	for (int i = 0; i < a_lines; ++i)
+	{
+		text += "line " + std::to_string(i) + "\n";
+	}
+	return text + "end";
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_write_suspends)
+{
+	constexpr int kLines = 20;
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto writer = std::make_shared<AsyncWriter>(2);
+	writer->add_stream(&slow);
+	Outputer out(writer);
+	SerialExecutor executor;
+	std::atomic<int> written{ 0 };
+
+	// the writer is held in its first write, the coroutine suspends once the queue is full, the thread goes on
+	write_lines(out, &executor, kLines, written);
+	gate.wait_entered();
+	executor.run_ready();
+	BOOST_CHECK(written.load() < kLines);
+
+	gate.open();
+	executor.run_until([&]() { return written.load() == kLines + 1; });
+	BOOST_CHECK_EQUAL(expected_lines(kLines), gate.str());
+	BOOST_CHECK_EQUAL(0u, writer->dropped());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_write_writer_thread)
+{
+	constexpr int kLines = 2000;
+	std::ostringstream s;
+	auto writer = std::make_shared<AsyncWriter>(4);
+	writer->add_stream(&s);
+	Outputer out(writer);
+	std::atomic<int> written{ 0 };
+
+	// without an executor the coroutine goes on on the writer thread
+	write_lines(out, nullptr, kLines, written);
+	BOOST_CHECK(eventually([&]() { return written.load() == kLines + 1; }));
+	writer->shutdown();
+	BOOST_CHECK_EQUAL(expected_lines(kLines), s.str());
+}
+
+DetachedTask write_once(Outputer & a_out, CoroutineExecutor * a_executor, std::atomic<int> & a_queued, const char * a_line = "late\n")
+{
+	a_queued = co_await a_out.async_write(a_line, a_executor) == true ? 1 : 0;
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_write_several_suspended)
+{
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto writer = std::make_shared<AsyncWriter>(2);
+	writer->add_stream(&slow);
+	Outputer out(writer);
+	SerialExecutor executor;
+	std::atomic<int> first{ -1 };
+	std::atomic<int> second{ -1 };
+
+	// both lines are deferred on one Outputer, each keeps its own
+	out << "a\n";
+	gate.wait_entered();
+	out << "b\n" << "c\n";
+	write_once(out, &executor, first, "A\n");
+	write_once(out, &executor, second, "B\n");
+	BOOST_CHECK_EQUAL(0u, executor.run_ready());
+	BOOST_CHECK_EQUAL(-1, first.load());
+	BOOST_CHECK_EQUAL(-1, second.load());
+
+	gate.open();
+	executor.run_until([&]() { return first.load() != -1 && second.load() != -1; });
+	writer->flush();
+	BOOST_CHECK_EQUAL(1, first.load());
+	BOOST_CHECK_EQUAL(1, second.load());
+	BOOST_CHECK_EQUAL("a\nb\nc\nA\nB\n", gate.str());
+	BOOST_CHECK_EQUAL(0u, writer->dropped());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_write_across_shutdown)
+{
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto writer = std::make_shared<AsyncWriter>(2);
+	writer->add_stream(&slow);
+	Outputer out(writer);
+	SerialExecutor executor;
+	std::atomic<int> queued{ -1 };
+
+	// the writer is held in its first write with the queue full, the line is deferred
+	out << "a\n";
+	gate.wait_entered();
+	out << "b\n" << "c\n";
+	write_once(out, &executor, queued);
+	BOOST_CHECK_EQUAL(0u, executor.run_ready());
+	BOOST_CHECK_EQUAL(-1, queued.load());
+
+	// the deferred line is dropped by the shutdown and its coroutine resumed with false
+	std::thread closer([&]() { writer->shutdown(); });
+	std::string probe;
+	while (writer->try_push(probe) == AsyncWriter::PushResult::Full)
+	{
+		std::this_thread::yield();
+	}
+	gate.open();
+	executor.run_until([&]() { return queued.load() != -1; });
+	closer.join();
+	BOOST_CHECK_EQUAL(0, queued.load());
+	BOOST_CHECK_EQUAL("a\nb\nc\n", gate.str());
+	BOOST_CHECK_EQUAL(2u, writer->dropped());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_async_write_other_modes)
+{
+	std::ostringstream s;
+	Outputer out(Outputer::Mode::FormatOnce);
+	out.add_stream(&s);
+	SerialExecutor executor;
+	std::atomic<int> written{ 0 };
+	write_lines(out, &executor, 3, written);
+	BOOST_CHECK_EQUAL(4, written.load());
+	BOOST_CHECK_EQUAL(0u, executor.run_ready());
+	BOOST_CHECK_EQUAL(expected_lines(3), s.str());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(test_outputer_parallel_slow_sink)
+{
+	GateBuffer gate;
+	std::ostream blocked(&gate);
+	std::ostringstream fast;
+	Outputer out(Outputer::Mode::Parallel);
+	out.add_stream(&blocked);
+	out.add_stream(&fast);
+	for (int i = 0; i < 10; ++i)
+	{
+		out << i << "\n";
+	}
+	out << "end";
+
+	// the blocked stream holds back nothing but itself
+	BOOST_REQUIRE(eventually([&]() { return out.lanes()->stats(1).written == 10; }));
+	BOOST_CHECK_EQUAL("0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n", fast.str());
+	BOOST_CHECK_EQUAL("", gate.str());
+
+	gate.open();
+	out.flush();
+	BOOST_CHECK_EQUAL("0\n1\n2\n3\n4\n5\n6\n7\n8\n9\nend", gate.str());
+	BOOST_CHECK_EQUAL(gate.str(), fast.str());
+	BOOST_CHECK_EQUAL(11u, out.lanes()->stats(0).written);
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_parallel_overflow)
+{
+	const std::pair<LaneWriter::Overflow, const char *> cases[] = {
+		{ LaneWriter::Overflow::DropNewest, "0\n1\n2\n" },
+		{ LaneWriter::Overflow::DropOldest, "0\n3\n4\n" },
+	};
+	for (const auto & c : cases)
+	{
+		GateBuffer gate;
+		std::ostream slow(&gate);
+		auto lanes = std::make_shared<LaneWriter>(6, c.first);
+		lanes->add_stream(&slow);
+		Outputer out(lanes);
+
+		// the worker takes the first line and waits in the stream, the lane holds four more bytes
+		out << "0\n";
+		gate.wait_entered();
+		out << "1\n" << "2\n" << "3\n" << "4\n";
+		BOOST_CHECK_EQUAL(4u, lanes->stats(0).queued_bytes);
+		BOOST_CHECK_EQUAL(2u, lanes->stats(0).in_flight_bytes);
+		BOOST_CHECK_EQUAL(2u, lanes->stats(0).dropped);
+
+		gate.open();
+		out.flush();
+		BOOST_CHECK_EQUAL(c.second, gate.str());
+		BOOST_CHECK_EQUAL(3u, lanes->stats(0).written);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_parallel_block)
+{
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto lanes = std::make_shared<LaneWriter>(6, LaneWriter::Overflow::Block);
+	lanes->add_stream(&slow);
+
+	std::atomic<bool> finished{ false };
+	std::thread producer([&]() {
+		Outputer out(lanes);
+		for (int i = 0; i < 6; ++i)
+		{
+			out << i << "\n";
+		}
+		out.flush();
+		finished = true;
+	});
+
+	// waits for room in the lane instead of dropping
+	gate.wait_entered();
+	BOOST_REQUIRE(eventually([&]() {
+		const LaneWriter::LaneStats stats = lanes->stats(0);
+		return stats.queued_bytes + stats.in_flight_bytes == 6;
+	}));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	BOOST_CHECK_EQUAL(false, finished.load());
+	BOOST_CHECK_EQUAL(0u, lanes->stats(0).dropped);
+	BOOST_CHECK_EQUAL(6u, lanes->stats(0).queued_bytes + lanes->stats(0).in_flight_bytes);
+
+	gate.open();
+	producer.join();
+	BOOST_CHECK_EQUAL("0\n1\n2\n3\n4\n5\n", gate.str());
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_parallel_in_flight)
+{
+	GateBuffer gate;
+	std::ostream slow(&gate);
+	auto lanes = std::make_shared<LaneWriter>(4, LaneWriter::Overflow::DropNewest);
+	lanes->add_stream(&slow);
+	Outputer out(lanes);
+
+	// the line the worker holds in the blocked stream keeps its room, the lane never holds more than its capacity
+	out << "0\n";
+	gate.wait_entered();
+	out << "1\n" << "2\n" << "3\n";
+	LaneWriter::LaneStats stats = lanes->stats(0);
+	BOOST_CHECK_EQUAL(2u, stats.queued_bytes);
+	BOOST_CHECK_EQUAL(2u, stats.in_flight_bytes);
+	BOOST_CHECK_LE(stats.queued_bytes + stats.in_flight_bytes, 4u);
+	BOOST_CHECK_EQUAL(2u, stats.dropped);
+
+	gate.open();
+	out.flush();
+	stats = lanes->stats(0);
+	BOOST_CHECK_EQUAL("0\n1\n", gate.str());
+	BOOST_CHECK_EQUAL(0u, stats.queued_bytes + stats.in_flight_bytes);
+	BOOST_CHECK_EQUAL(2u, stats.written);
+}
+
+BOOST_AUTO_TEST_CASE(test_outputer_parallel_producers)
+{
+	constexpr int kThreads = 3;
+	constexpr int kLines = 40;
+	SlowBuffer slow1(std::chrono::microseconds(500));
+	SlowBuffer slow2(std::chrono::microseconds(200));
+	std::ostream s1(&slow1);
+	std::ostream s2(&slow2);
+	std::ostringstream fast;
+	auto lanes = std::make_shared<LaneWriter>(256, LaneWriter::Overflow::Block, 2);
+	lanes->add_stream(&s1);
+	lanes->add_stream(&s2);
+	lanes->add_stream(&fast);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < kThreads; ++t)
+	{
+		threads.emplace_back([lanes, t]() {
+			Outputer out(lanes);
+			for (int i = 0; i < kLines; ++i)
+			{
+				out << "thread " << t << " line " << i << "\n";
+			}
+		});
+	}
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+	lanes->shutdown();
+
+	check_lines(slow1.str(), kThreads, kLines);
+	check_lines(slow2.str(), kThreads, kLines);
+	check_lines(fast.str(), kThreads, kLines);
+	for (std::size_t lane = 0; lane < lanes->lanes(); ++lane)
+	{
+		BOOST_CHECK_EQUAL(static_cast<std::size_t>(kThreads * kLines), lanes->stats(lane).written);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_outputer_producers)
+{
+	constexpr int kThreads = 8;
+	constexpr int kLines = 5000;
+	std::ostringstream s;
+	std::size_t batches = 0;
+	{
+		ConcurrentOutputer out(1024, std::chrono::milliseconds(1));
+		out.add_stream(&s);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < kThreads; ++t)
+		{
+			threads.emplace_back([&out, t]() {
+				for (int i = 0; i < kLines; ++i)
+				{
+					out << "thread " << t << " line " << i << "\n";
+				}
+			});
+		}
+		for (auto & thread : threads)
+		{
+			thread.join();
+		}
+		out.flush();
+		batches = out.batches();
+	}
+	check_lines(s.str(), kThreads, kLines);
+	// whole buffers, not single records
+	BOOST_CHECK(batches < static_cast<std::size_t>(kThreads * kLines / 10));
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_outputer_flush)
+{
+	std::ostringstream s;
+	ConcurrentOutputer out(1 << 20, std::chrono::milliseconds(0));
+	out.add_stream(&s);
+	out << "first " << 1 << '\n';
+	BOOST_CHECK_EQUAL("", s.str());
+
+	// a thread that is gone leaves its records behind
+	std::thread([&out]() { out << "second " << 2.5 << '\n'; }).join();
+	out.flush();
+	const std::string text = s.str();
+	BOOST_CHECK(text == "first 1\nsecond 2.5\n" || text == "second 2.5\nfirst 1\n");
+	BOOST_CHECK_EQUAL(2u, out.batches());
+
+	// manipulators stay with the thread that wrote them
+	out << std::hex << 255 << '\n';
+	std::thread([&out]() { out << 255 << '\n'; }).join();
+	out << 255 << '\n';
+	out.flush();
+	BOOST_CHECK(s.str().find("ff\nff\n") != std::string::npos);
+	BOOST_CHECK(s.str().find("255\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_outputer_periodic_flush)
+{
+	GateBuffer gate;
+	gate.open();
+	std::ostream stream(&gate);
+	ConcurrentOutputer out(1 << 20, std::chrono::milliseconds(5));
+	out.add_stream(&stream);
+	out << "record " << 1 << '\n';
+	BOOST_CHECK(eventually([&]() { return gate.str() == "record 1\n"; }));
+}
+
+#if defined(__linux__)
+BOOST_AUTO_TEST_CASE(test_uring_file_sink)
+{
+	for (auto backend : { UringFileBuf::Backend::Auto, UringFileBuf::Backend::Pwritev })
+	{
+		TempFile file("uring.txt");
+		std::string expected;
+		{
+			Outputer out(Outputer::Mode::FormatOnce);
+			auto stream = std::make_shared<UringFileStream>(file.path(), false, backend);
+			BOOST_CHECK_EQUAL(false, stream->fail());
+			if (backend == UringFileBuf::Backend::Pwritev)
+			{
+				BOOST_CHECK_EQUAL(false, stream->uses_uring());
+			}
+			out.add_stream(stream);
+
+			// several times all buffers, with partial buffers flushed in between
+			for (int i = 0; i < 40000; ++i)
+			{
+				out << "line " << i << "\n";
+				expected += "line " + std::to_string(i) + "\n";
+				if (i % 9999 == 0)
+				{
+					out.flush();
+					BOOST_CHECK_EQUAL(expected, file.read());
+				}
+			}
+			const std::string big(3 * UringFileBuf::kBufferSize + 17, 'x');
+			out << big;
+			expected += big;
+		}
+		BOOST_CHECK(expected == file.read());
+
+		// appends behind what is there
+		{
+			UringFileStream stream(file.path(), true, backend);
+			stream << "appended";
+			stream.close();
+			BOOST_CHECK_EQUAL(false, stream.fail());
+		}
+		BOOST_CHECK(expected + "appended" == file.read());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uring_file_sink_open_failure)
+{
+	CerrCapture errors;
+	Outputer out(Outputer::Mode::FormatOnce);
+	auto stream = std::make_shared<UringFileStream>("/nonexistent-directory/file.txt");
+	BOOST_CHECK_EQUAL(true, stream->fail());
+	out.add_stream(stream);
+	out << "dropped";
+	BOOST_CHECK_EQUAL("invalid stream\n", errors.str());
+}
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+BOOST_AUTO_TEST_CASE(test_mapped_file_sink)
+{
+	TempFile file("mapped.txt");
+	std::string expected;
+	{
+		Outputer out(Outputer::Mode::FormatOnce);
+		auto stream = std::make_shared<MappedFileStream>(file.path(), 0, 4096);
+		BOOST_CHECK_EQUAL(false, stream->fail());
+		out.add_stream(stream);
+
+		// many chunks, and a value larger than a chunk
+		for (int i = 0; i < 10000; ++i)
+		{
+			out << "line " << i << "\n";
+			expected += "line " + std::to_string(i) + "\n";
+		}
+		const std::string big(3 * 4096 + 17, 'x');
+		out << big;
+		expected += big;
+
+		// the file is cut to its contents on close
+		stream->close();
+		BOOST_CHECK_EQUAL(false, stream->fail());
+		BOOST_CHECK_EQUAL(0u, stream->file_index());
+	}
+	BOOST_CHECK_EQUAL(expected.size(), std::filesystem::file_size(file.path()));
+	BOOST_CHECK(expected == file.read());
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_file_sink_rolling)
+{
+	constexpr std::size_t kLimit = 10000;
+	constexpr std::size_t kFiles = 8;
+	std::vector<std::unique_ptr<TempFile>> files;
+	for (std::size_t i = 0; i < kFiles; ++i)
+	{
+		files.push_back(std::make_unique<TempFile>(i == 0 ? "rolling.txt" : "rolling.txt." + std::to_string(i)));
+	}
+	std::string expected;
+	std::size_t rolls = 0;
+	{
+		// whole lines reach the stream in one write
+		Outputer out(Outputer::Mode::Async);
+		auto stream = std::make_shared<MappedFileStream>(files[0]->path(), kLimit, 4096);
+		out.add_stream(stream);
+		for (int i = 0; i < 5000; ++i)
+		{
+			out << "line " << i << "\n";
+			expected += "line " + std::to_string(i) + "\n";
+		}
+		out.flush();
+		rolls = stream->file_index();
+		BOOST_CHECK_EQUAL(files[1]->path(), stream->file_path(1));
+	}
+	BOOST_REQUIRE(rolls < kFiles);
+	BOOST_CHECK_EQUAL(expected.size() / kLimit, rolls);
+
+	// no line is split between two files
+	std::string joined;
+	for (std::size_t i = 0; i <= rolls; ++i)
+	{
+		const std::string text = files[i]->read();
+		BOOST_CHECK(text.size() <= kLimit);
+		BOOST_CHECK(text.empty() == false && text.back() == '\n');
+		BOOST_CHECK_EQUAL(0, text.compare(0, 5, "line "));
+		joined += text;
+	}
+	BOOST_CHECK(expected == joined);
+	BOOST_CHECK_EQUAL(false, std::filesystem::exists(files[rolls + 1]->path()));
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_file_sink_open_failure)
+{
+	CerrCapture errors;
+	Outputer out(Outputer::Mode::FormatOnce);
+	auto stream = std::make_shared<MappedFileStream>("/nonexistent-directory/file.txt");
+	BOOST_CHECK_EQUAL(true, stream->fail());
+	out.add_stream(stream);
+	out << "dropped";
+	BOOST_CHECK_EQUAL("invalid stream\n", errors.str());
+}
+#endif
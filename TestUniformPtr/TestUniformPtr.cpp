@@ -1,11 +1,194 @@
 #define BOOST_TEST_MODULE TestUniformPtr
+#define AKT_UNIFORM_PTR_STATS
 
 #include <boost/test/included/unit_test.hpp>
 
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
 #include <memory>
-
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../atomic_uniform_ptr.hpp"
+#include "../reclamation_domain.hpp"
 #include "../uniform_ptr.hpp"
 
+// counts heap allocations made by the test, through every overload of operator new
+static std::atomic<std::size_t> g_allocations{ 0 };
+
+static void* allocate(std::size_t size, std::size_t align) noexcept
+{
+	++g_allocations;
+	size = size == 0 ? 1 : size;
+	if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+	{
+		return std::malloc(size);
+	}
+#ifdef _MSC_VER
+	return _aligned_malloc(size, align);
+#else
+	return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+}
+
+static void deallocate(void* p, std::size_t align) noexcept
+{
+#ifdef _MSC_VER
+	if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+	{
+		_aligned_free(p);
+		return;
+	}
+#else
+	(void)align;
+#endif
+	std::free(p);
+}
+
+// GCC pairs the inlined operator new with free() and takes them for a mismatch
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size)
+{
+	if (void* p = allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+	if (void* p = allocate(size, static_cast<std::size_t>(align)))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	return allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p) noexcept
+{
+	deallocate(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	deallocate(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void* p, std::align_val_t align) noexcept
+{
+	deallocate(p, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t align) noexcept
+{
+	deallocate(p, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	deallocate(p, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void* p, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+	deallocate(p, static_cast<std::size_t>(align));
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+class AllocationCounter {
+public:
+	std::size_t count() const { return g_allocations - m_start; }
+private:
+	std::size_t m_start = g_allocations;
+};
+
+// uniform_ptr statistics of this thread since construction
+class StatsCounter {
+public:
+	akt::uniform_ptr_stats count() const
+	{
+		const akt::uniform_ptr_stats& now = akt::this_thread_uniform_ptr_stats();
+		akt::uniform_ptr_stats delta;
+		delta.allocations = now.allocations - m_start.allocations;
+		delta.deallocations = now.deallocations - m_start.deallocations;
+		delta.ref_increments = now.ref_increments - m_start.ref_increments;
+		delta.ref_decrements = now.ref_decrements - m_start.ref_decrements;
+		delta.indirect_calls = now.indirect_calls - m_start.indirect_calls;
+		return delta;
+	}
+private:
+	akt::uniform_ptr_stats m_start = akt::this_thread_uniform_ptr_stats();
+};
+
+static void check_stats(const StatsCounter& a_counter, std::size_t a_allocations, std::size_t a_deallocations,
+	std::size_t a_increments, std::size_t a_decrements, std::size_t a_indirectCalls)
+{
+	const akt::uniform_ptr_stats stats = a_counter.count();
+	BOOST_CHECK_EQUAL(a_allocations, stats.allocations);
+	BOOST_CHECK_EQUAL(a_deallocations, stats.deallocations);
+	BOOST_CHECK_EQUAL(a_increments, stats.ref_increments);
+	BOOST_CHECK_EQUAL(a_decrements, stats.ref_decrements);
+	BOOST_CHECK_EQUAL(a_indirectCalls, stats.indirect_calls);
+}
+
+struct AllocatorStats {
+	std::size_t allocations = 0;
+	std::size_t deallocations = 0;
+};
+
+// counts what it allocates into the shared stats
+template<typename T>
+class CountingAllocator {
+public:
+	using value_type = T;
+
+	explicit CountingAllocator(AllocatorStats& a_stats) : m_stats(&a_stats) {}
+	template<typename U>
+	CountingAllocator(const CountingAllocator<U>& rhv) : m_stats(rhv.m_stats) {}
+
+	T* allocate(std::size_t n)
+	{
+		++m_stats->allocations;
+		return static_cast<T*>(std::malloc(n * sizeof(T)));
+	}
+	void deallocate(T* p, std::size_t)
+	{
+		++m_stats->deallocations;
+		std::free(p);
+	}
+
+	template<typename U>
+	bool operator==(const CountingAllocator<U>& rhv) const { return m_stats == rhv.m_stats; }
+	template<typename U>
+	bool operator!=(const CountingAllocator<U>& rhv) const { return m_stats != rhv.m_stats; }
+
+	AllocatorStats* m_stats;
+};
+
 // used as base class
 class IntValue {
 public:
@@ -48,6 +231,62 @@ private:
 	int m_value = 0;
 };
 
+// Neither copyable nor movable
+class IntPinned final : public IntValue {
+public:
+	explicit IntPinned(int a_value) : m_value(a_value) {}
+	IntPinned(const IntPinned &) = delete;
+	IntPinned & operator=(const IntPinned &) = delete;
+
+	int getInt() const override { return m_value; }
+	void setInt(int val) override { m_value = val; }
+private:
+	int m_value = 0;
+};
+
+// counts how it was constructed
+struct Counted {
+	static int s_copies;
+	static int s_moves;
+
+	explicit Counted(int a_value) : m_value(a_value) {}
+	Counted(const Counted & rhv) : m_value(rhv.m_value) { ++s_copies; }
+	Counted(Counted && rhv) noexcept : m_value(rhv.m_value) { ++s_moves; }
+
+	int m_value = 0;
+};
+int Counted::s_copies = 0;
+int Counted::s_moves = 0;
+
+// IntValue is the second base, so converting a pointer to it changes the address
+class Tagged {
+public:
+	virtual ~Tagged() {}
+	int m_tag = 0;
+};
+
+class IntTagged final : public Tagged, public IntValue {
+public:
+	explicit IntTagged(int a_value) : m_value(a_value) {}
+
+	int getInt() const override { return m_value; }
+	void setInt(int val) override { m_value = val; }
+private:
+	int m_value = 0;
+};
+
+// handles that need no dynamic initialization
+#ifdef __cpp_constinit
+static int g_constValue = 5;
+static IntNonCopyable g_constObject(6);
+constinit akt::uniform_ptr<int> g_nullPtr;
+constinit akt::uniform_ptr<int> g_intPtr = &g_constValue;
+constinit akt::uniform_ptr<IntValue> g_basePtr = &g_constObject;
+constinit akt::uniform_ptr<int, akt::inline_policy<sizeof(int)>> g_inlinePtr = &g_constValue;
+constinit akt::uniform_unique_ptr<int> g_uniquePtr = &g_constValue;
+constinit akt::uniform_ptr<int> g_ptrTable[] = { &g_constValue, nullptr, &g_constValue };
+#endif
+
 BOOST_AUTO_TEST_CASE(test_uniform_ptr_default_ctor)
 {
 	BOOST_CHECK(nullptr == akt::uniform_ptr<char>{}.get());
@@ -1099,3 +1338,1058 @@ BOOST_AUTO_TEST_CASE(test_uniform_ptr_bool_cast)
 	BOOST_CHECK(false == (bool)akt::uniform_ptr<IntNonCopyable>{nullptr});
 }
 
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_converting_ctor_is_flat)
+{
+	{
+		std::shared_ptr<IntTagged> val = std::make_shared<IntTagged>(50);
+		akt::uniform_ptr<IntTagged> p1{ val };
+		BOOST_CHECK_EQUAL(2, val.use_count()); // uniform_ptr keeps one copy of the shared_ptr for all its copies
+		akt::uniform_ptr<IntValue> p2{ p1 };
+		akt::uniform_ptr<const IntValue> p3{ p2 };
+		// every conversion adds one more owner of the same object instead of wrapping the source handle
+		BOOST_CHECK_EQUAL(2, val.use_count());
+		BOOST_CHECK_EQUAL(3, p1.use_count());
+		BOOST_CHECK_EQUAL(3, p3.use_count());
+		BOOST_CHECK(static_cast<IntValue*>(val.get()) == p2.get());
+		BOOST_CHECK(static_cast<const IntValue*>(val.get()) == p3.get());
+		BOOST_CHECK(static_cast<void*>(val.get()) != static_cast<const void*>(p3.get()));
+
+		p1 = nullptr;
+		p2 = nullptr;
+		BOOST_CHECK_EQUAL(1, p3.use_count());
+		val.reset();
+		BOOST_CHECK_EQUAL(1, p3.use_count());
+		BOOST_CHECK_EQUAL(50, p3->getInt());
+	}
+
+	{
+		akt::uniform_ptr<IntTagged> p1{ IntTagged{ 51 } };
+		akt::uniform_ptr<const IntValue> p2{ akt::uniform_ptr<IntValue>{ std::move(p1) } };
+		BOOST_CHECK_EQUAL(false, (bool)p1);
+		BOOST_CHECK_EQUAL(1, p2.use_count());
+		BOOST_CHECK_EQUAL(51, p2->getInt());
+	}
+
+	{
+		IntTagged i{ 52 };
+		akt::uniform_ptr<const IntValue> p{ akt::uniform_ptr<IntValue>{ akt::uniform_ptr<IntTagged>{ &i } } };
+		BOOST_CHECK(static_cast<const IntValue*>(&i) == p.get());
+		BOOST_CHECK_EQUAL(0, p.use_count()); // non-owning pointer stays non-owning
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_converting_assign_op_is_flat)
+{
+	std::shared_ptr<IntTagged> val = std::make_shared<IntTagged>(53);
+	akt::uniform_ptr<IntTagged> p1{ val };
+	akt::uniform_ptr<IntValue> p2;
+	akt::uniform_ptr<const IntValue> p3;
+	p2 = p1;
+	p3 = p2;
+	BOOST_CHECK_EQUAL(3, p1.use_count());
+	BOOST_CHECK_EQUAL(3, p3.use_count());
+	BOOST_CHECK(static_cast<const IntValue*>(val.get()) == p3.get());
+
+	akt::uniform_ptr<const IntValue> p4;
+	p4 = std::move(p2);
+	BOOST_CHECK_EQUAL(false, (bool)p2);
+	BOOST_CHECK_EQUAL(3, p4.use_count());
+	BOOST_CHECK(p3.get() == p4.get());
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_inline_value)
+{
+	using char_ptr = akt::uniform_ptr<char, akt::inline_policy<sizeof(char)>>;
+	{
+		AllocationCounter allocs;
+		const char A = 'A';
+		char_ptr p1{ A };
+		char_ptr p2{ 'B' };
+		char_ptr p3{ p1 };
+		char_ptr p4{ std::move(p2) };
+		p2 = p3;
+		p1 = std::move(p4);
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(0u, count);
+		BOOST_CHECK_EQUAL('B', *p1);
+		BOOST_CHECK_EQUAL('A', *p2);
+		BOOST_CHECK_EQUAL('A', *p3);
+		BOOST_CHECK_EQUAL(false, (bool)p4);
+	}
+
+	{
+		// every copy owns its own value
+		char_ptr p1{ 'A' };
+		char_ptr p2{ p1 };
+		BOOST_CHECK(p1.get() != p2.get());
+		BOOST_CHECK_EQUAL(1, p1.use_count());
+		*p1 = 'C';
+		BOOST_CHECK_EQUAL('C', *p1);
+		BOOST_CHECK_EQUAL('A', *p2);
+	}
+
+	{
+		AllocationCounter allocs;
+		akt::uniform_ptr<bool, akt::inline_policy<8>> p1{ true };
+		akt::uniform_ptr<long long, akt::inline_policy<8>> p2{ 3LL };
+		akt::uniform_ptr<const long long, akt::inline_policy<8>> p3{ 4LL };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(0u, count);
+		BOOST_CHECK_EQUAL(true, *p1);
+		BOOST_CHECK_EQUAL(3LL, *p2);
+		BOOST_CHECK_EQUAL(4LL, *p3);
+	}
+
+	{
+		// the default policy keeps values on the heap
+		AllocationCounter allocs;
+		akt::uniform_ptr<char> p1{ 'A' };
+		akt::uniform_ptr<char> p2{ p1 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count);
+		BOOST_CHECK(p1.get() == p2.get());
+	}
+
+	{
+		// over-aligned values are allocated by the aligned operator new, counted as well
+		struct alignas(64) Wide {
+			char c;
+		};
+		AllocationCounter allocs;
+		akt::uniform_ptr<Wide> p1{ Wide{ 'W' } };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count);
+		BOOST_CHECK_EQUAL(0u, reinterpret_cast<std::uintptr_t>(p1.get()) % 64);
+		BOOST_CHECK_EQUAL('W', p1->c);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_inline_value_conversion)
+{
+	using policy = akt::inline_policy<sizeof(IntTagged), alignof(IntTagged)>;
+	AllocationCounter allocs;
+	akt::uniform_ptr<IntTagged, policy> p1{ IntTagged{ 54 } };
+	akt::uniform_ptr<IntValue, policy> p2{ p1 };
+	akt::uniform_ptr<IntValue, policy> p3{ std::move(p1) };
+	akt::uniform_ptr<const IntValue, policy> p4;
+	p4 = p3;
+	const std::size_t count = allocs.count();
+	BOOST_CHECK_EQUAL(0u, count);
+	BOOST_CHECK_EQUAL(false, (bool)p1);
+	BOOST_CHECK_EQUAL(54, p2->getInt());
+	BOOST_CHECK_EQUAL(54, p3->getInt());
+	BOOST_CHECK_EQUAL(54, p4->getInt());
+	p2->setInt(55);
+	BOOST_CHECK_EQUAL(55, p2->getInt());
+	BOOST_CHECK_EQUAL(54, p3->getInt());
+	BOOST_CHECK(dynamic_cast<const IntTagged*>(p4.get()) != nullptr); // pointer is adjusted to the IntValue base of the copy
+	BOOST_CHECK(static_cast<const void*>(p4.get()) != static_cast<const void*>(dynamic_cast<const IntTagged*>(p4.get())));
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_inline_value_fallback)
+{
+	using policy = akt::inline_policy<64>;
+	static_assert(sizeof(IntNonCopyable) <= 64 && sizeof(IntNonMovable) <= 64);
+	{
+		// IntNonCopyable can't be deep-copied, it is shared
+		AllocationCounter allocs;
+		akt::uniform_ptr<IntValue, policy> p1{ IntNonCopyable{ 56 } };
+		akt::uniform_ptr<IntValue, policy> p2{ p1 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count);
+		BOOST_CHECK_EQUAL(p1.get(), p2.get());
+		BOOST_CHECK_EQUAL(2, p1.use_count());
+	}
+
+	{
+		// IntNonMovable can't be moved between uniform_ptrs, it is shared
+		akt::uniform_ptr<IntValue, policy> p1{ IntNonMovable{ 57 } };
+		akt::uniform_ptr<IntValue, policy> p2{ p1 };
+		BOOST_CHECK_EQUAL(p1.get(), p2.get());
+		BOOST_CHECK_EQUAL(57, p2->getInt());
+	}
+
+	{
+		// too big for the buffer
+		using small_policy = akt::inline_policy<1>;
+		AllocationCounter allocs;
+		akt::uniform_ptr<int, small_policy> p1{ 58 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count);
+		BOOST_CHECK_EQUAL(58, *p1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_unique_ptr_ctor)
+{
+	static_assert(!std::is_copy_constructible_v<akt::uniform_unique_ptr<int>>);
+	static_assert(!std::is_copy_assignable_v<akt::uniform_unique_ptr<int>>);
+
+	BOOST_CHECK(nullptr == akt::uniform_unique_ptr<int>{}.get());
+	BOOST_CHECK(nullptr == akt::uniform_unique_ptr<IntValue>{ nullptr }.get());
+	BOOST_CHECK_EQUAL(1, *akt::uniform_unique_ptr<int>{ 1 });
+	BOOST_CHECK_EQUAL(2, akt::uniform_unique_ptr<IntValue>{ IntNonCopyable{ 2 } }->getInt());
+	BOOST_CHECK_EQUAL(3, akt::uniform_unique_ptr<IntValue>{ std::make_unique<IntNonMovable>(3) }->getInt());
+	BOOST_CHECK_EQUAL(4, akt::uniform_unique_ptr<IntValue>{ std::make_unique<IntTagged>(4) }->getInt());
+	{
+		IntNonMovable i{ 5 };
+		akt::uniform_unique_ptr<IntValue> p{ &i };
+		BOOST_CHECK(&i == p.get());
+		BOOST_CHECK_EQUAL(false, p.owns());
+	}
+	{
+		// the unique_ptr is adopted as is
+		AllocationCounter allocs;
+		auto u = std::make_unique<IntTagged>(6);
+		IntTagged* raw = u.get();
+		akt::uniform_unique_ptr<IntValue> p{ std::move(u) };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count);
+		BOOST_CHECK(static_cast<IntValue*>(raw) == p.get());
+		BOOST_CHECK_EQUAL(true, p.owns());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_unique_ptr_move)
+{
+	{
+		akt::uniform_unique_ptr<IntTagged> p1{ IntTagged{ 7 } };
+		akt::uniform_unique_ptr<IntTagged> p2{ std::move(p1) };
+		BOOST_CHECK_EQUAL(false, (bool)p1);
+		BOOST_CHECK_EQUAL(7, p2->getInt());
+		akt::uniform_unique_ptr<const IntValue> p3{ std::move(p2) };
+		BOOST_CHECK_EQUAL(false, (bool)p2);
+		BOOST_CHECK_EQUAL(7, p3->getInt());
+		p3 = akt::uniform_unique_ptr<IntValue>{ IntNonCopyable{ 8 } };
+		BOOST_CHECK_EQUAL(8, p3->getInt());
+		p3 = std::move(p3);
+		BOOST_CHECK_EQUAL(8, p3->getInt());
+		p3 = nullptr;
+		BOOST_CHECK_EQUAL(false, (bool)p3);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_unique_ptr_to_uniform_ptr)
+{
+	static_assert(std::is_constructible_v<akt::uniform_ptr<IntValue>, akt::uniform_unique_ptr<IntTagged>&&>);
+	static_assert(!std::is_convertible_v<akt::uniform_unique_ptr<IntValue>&&, akt::uniform_ptr<IntValue>>); // only on request
+	static_assert(!std::is_constructible_v<akt::uniform_ptr<IntValue>, const akt::uniform_unique_ptr<IntValue>&>);
+
+	{
+		akt::uniform_unique_ptr<IntTagged> p1{ IntTagged{ 9 } };
+		const IntTagged* raw = p1.get();
+		akt::uniform_ptr<IntValue> p2{ std::move(p1) };
+		BOOST_CHECK_EQUAL(false, (bool)p1);
+		BOOST_CHECK(static_cast<const IntValue*>(raw) == p2.get());
+		BOOST_CHECK_EQUAL(1, p2.use_count());
+		akt::uniform_ptr<IntValue> p3{ p2 };
+		BOOST_CHECK_EQUAL(2, p3.use_count());
+		BOOST_CHECK_EQUAL(9, p3->getInt());
+	}
+	{
+		int i = 10;
+		akt::uniform_ptr<int> p{ akt::uniform_unique_ptr<int>{ &i } };
+		BOOST_CHECK(&i == p.get());
+		BOOST_CHECK_EQUAL(0, p.use_count());
+	}
+	BOOST_CHECK_EQUAL(false, (bool)akt::uniform_ptr<int>{ akt::uniform_unique_ptr<int>{} });
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_single_thread_rc)
+{
+	using ptr = akt::uniform_ptr<IntValue, akt::single_thread_rc>;
+	{
+		ptr p1{ IntTagged{ 60 } };
+		ptr p2{ p1 };
+		akt::uniform_ptr<const IntValue, akt::single_thread_rc> p3{ p2 };
+		BOOST_CHECK_EQUAL(3, p1.use_count());
+		BOOST_CHECK(p1.get() == p3.get());
+		p1 = nullptr;
+		BOOST_CHECK_EQUAL(2, p3.use_count());
+		BOOST_CHECK_EQUAL(60, p3->getInt());
+	}
+	{
+		auto val = std::make_shared<IntTagged>(61);
+		ptr p1{ val };
+		ptr p2{ std::make_unique<IntNonCopyable>(62) };
+		ptr p3{ p2 };
+		BOOST_CHECK_EQUAL(61, p1->getInt());
+		BOOST_CHECK_EQUAL(2, p3.use_count());
+		BOOST_CHECK_EQUAL(62, p3->getInt());
+	}
+
+	// ownership is never shared between different policies
+	static_assert(!std::is_constructible_v<ptr, const akt::uniform_ptr<IntValue>&>);
+	static_assert(!std::is_constructible_v<ptr, akt::uniform_ptr<IntTagged>&&>);
+	static_assert(!std::is_constructible_v<akt::uniform_ptr<IntValue>, const ptr&>);
+	static_assert(!std::is_assignable_v<ptr&, const akt::uniform_ptr<IntValue>&>);
+	static_assert(!std::is_assignable_v<akt::uniform_ptr<IntValue>&, akt::uniform_ptr<IntTagged, akt::single_thread_rc>&&>);
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_allocator_ctor)
+{
+	AllocatorStats stats;
+	{
+		AllocationCounter allocs;
+		const IntTagged val{ 70 };
+		akt::uniform_ptr<IntValue> p1{ std::allocator_arg, CountingAllocator<char>(stats), val };
+		akt::uniform_ptr<IntValue> p2{ std::allocator_arg, CountingAllocator<char>(stats), IntNonCopyable{ 71 } };
+		akt::uniform_ptr<IntValue> p3{ std::allocator_arg, CountingAllocator<char>(stats), std::in_place_type<IntNonMovable>, 72 };
+		akt::uniform_ptr<const IntValue> p4{ p3 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(0u, count); // the control block and the value come from the allocator
+		BOOST_CHECK_EQUAL(3u, stats.allocations);
+		BOOST_CHECK_EQUAL(70, p1->getInt());
+		BOOST_CHECK_EQUAL(71, p2->getInt());
+		BOOST_CHECK_EQUAL(72, p4->getInt());
+		BOOST_CHECK_EQUAL(2, p4.use_count());
+	}
+	BOOST_CHECK_EQUAL(3u, stats.deallocations);
+
+	{
+		// the allocator always puts the value on its heap
+		akt::uniform_ptr<int, akt::inline_policy<sizeof(int)>> p{ std::allocator_arg, CountingAllocator<int>(stats), 73 };
+		BOOST_CHECK_EQUAL(73, *p);
+		BOOST_CHECK_EQUAL(4u, stats.allocations);
+	}
+	BOOST_CHECK_EQUAL(4u, stats.deallocations);
+}
+
+BOOST_AUTO_TEST_CASE(test_make_uniform_pmr)
+{
+	alignas(std::max_align_t) unsigned char buffer[4096];
+	std::pmr::monotonic_buffer_resource arena{ buffer, sizeof(buffer), std::pmr::null_memory_resource() };
+	{
+		AllocationCounter allocs;
+		akt::uniform_ptr<int> p1 = akt::make_uniform_pmr<int>(&arena, 74);
+		akt::uniform_ptr<IntValue> p2 = akt::make_uniform_pmr<IntValue, IntNonMovable>(&arena, 75);
+		// the string gets the arena through uses-allocator construction
+		akt::uniform_ptr<std::pmr::string> p3 = akt::make_uniform_pmr<std::pmr::string>(&arena, "a string which is too long for the small string buffer");
+		akt::uniform_ptr<std::pmr::string> p4{ p3 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(0u, count);
+		BOOST_CHECK_EQUAL(74, *p1);
+		BOOST_CHECK_EQUAL(75, p2->getInt());
+		BOOST_CHECK(p3->get_allocator().resource() == &arena);
+		BOOST_CHECK_EQUAL(2, p4.use_count());
+	}
+	{
+		// with another policy
+		AllocationCounter allocs;
+		akt::uniform_ptr<IntValue, akt::single_thread_rc> p1 = akt::make_uniform_pmr<IntValue, IntNonMovable, akt::single_thread_rc>(&arena, 76);
+		akt::uniform_ptr<IntValue, akt::single_thread_rc> p2{ p1 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(0u, count);
+		BOOST_CHECK_EQUAL(76, p2->getInt());
+		BOOST_CHECK_EQUAL(2, p1.use_count());
+	}
+	arena.release();
+}
+
+BOOST_AUTO_TEST_CASE(test_make_uniform)
+{
+	static_assert(!std::is_copy_constructible_v<IntPinned> && !std::is_move_constructible_v<IntPinned>);
+	{
+		AllocationCounter allocs;
+		akt::uniform_ptr<IntPinned> p1 = akt::make_uniform<IntPinned>(80);
+		akt::uniform_ptr<IntValue> p2 = akt::make_uniform<IntValue, IntPinned>(81);
+		akt::uniform_ptr<IntValue> p3{ p2 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(2u, count); // one per object
+		BOOST_CHECK_EQUAL(80, p1->getInt());
+		BOOST_CHECK_EQUAL(81, p3->getInt());
+		BOOST_CHECK_EQUAL(2, p3.use_count());
+	}
+	{
+		Counted::s_copies = 0;
+		Counted::s_moves = 0;
+		akt::uniform_ptr<Counted> p1 = akt::make_uniform<Counted>(82);
+		akt::uniform_ptr<const Counted> p2 = akt::make_uniform<const Counted, Counted>(83);
+		BOOST_CHECK_EQUAL(0, Counted::s_copies);
+		BOOST_CHECK_EQUAL(0, Counted::s_moves);
+		BOOST_CHECK_EQUAL(82, p1->m_value);
+		BOOST_CHECK_EQUAL(83, p2->m_value);
+	}
+	{
+		// in place into the buffer of the handle
+		AllocationCounter allocs;
+		akt::uniform_ptr<Counted, akt::inline_policy<sizeof(Counted)>> p{ std::in_place_type<Counted>, 84 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(0u, count);
+		BOOST_CHECK_EQUAL(0, Counted::s_moves);
+		BOOST_CHECK_EQUAL(84, p->m_value);
+	}
+	{
+		// fits the buffer, but it could not be moved together with the handle, so it goes to the heap
+		akt::uniform_ptr<IntValue, akt::inline_policy<64>> p{ std::in_place_type<IntPinned>, 85 };
+		BOOST_CHECK_EQUAL(85, p->getInt());
+		BOOST_CHECK_EQUAL(1, p.use_count());
+	}
+	{
+		// the policy of the handle is chosen as well
+		AllocationCounter allocs;
+		akt::uniform_ptr<Counted, akt::inline_policy<sizeof(Counted)>> p1 = akt::make_uniform<Counted, Counted, akt::inline_policy<sizeof(Counted)>>(86);
+		akt::uniform_ptr<IntValue, akt::single_thread_rc> p2 = akt::make_uniform<IntValue, IntPinned, akt::single_thread_rc>(87);
+		akt::uniform_ptr<IntValue, akt::single_thread_rc> p3{ p2 };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count); // none for the value in place
+		BOOST_CHECK_EQUAL(86, p1->m_value);
+		BOOST_CHECK_EQUAL(87, p3->getInt());
+		BOOST_CHECK_EQUAL(2, p2.use_count());
+	}
+	{
+		// a shared_ptr source costs its block on top of the allocation of std::make_shared
+		auto shared = std::make_shared<IntNonCopyable>(88);
+		AllocationCounter allocs;
+		akt::uniform_ptr<IntValue> p{ shared };
+		const std::size_t count = allocs.count();
+		BOOST_CHECK_EQUAL(1u, count);
+		BOOST_CHECK_EQUAL(88, p->getInt());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_stats)
+{
+	using inline_ptr = akt::uniform_ptr<int, akt::inline_policy<sizeof(int)>>;
+	int i = 90;
+	{
+		StatsCounter stats;
+		akt::uniform_ptr<int> p1;
+		akt::uniform_ptr<int> p2{ nullptr };
+		akt::uniform_ptr<int> p3{ &i };
+		akt::uniform_ptr<int> p4{ p3 };
+		akt::uniform_ptr<int> p5{ std::move(p4) };
+		akt::uniform_unique_ptr<int> p6{ &i };
+		check_stats(stats, 0, 0, 0, 0, 0);
+	}
+	{
+		StatsCounter stats;
+		akt::uniform_ptr<IntValue> p{ IntNonCopyable(91) };
+		check_stats(stats, 1, 0, 0, 0, 0);
+	}
+	{
+		const IntNonMovable val(92);
+		StatsCounter stats;
+		akt::uniform_ptr<IntValue> p{ val };
+		check_stats(stats, 1, 0, 0, 0, 0);
+	}
+	{
+		auto sp = std::make_shared<int>(93);
+		StatsCounter stats;
+		akt::uniform_ptr<int> p{ sp };
+		check_stats(stats, 1, 0, 0, 0, 0);
+	}
+	{
+		auto up = std::make_unique<int>(94);
+		StatsCounter stats;
+		akt::uniform_ptr<int> p{ std::move(up) };
+		check_stats(stats, 1, 0, 0, 0, 0);
+	}
+	{
+		StatsCounter stats;
+		akt::uniform_unique_ptr<int> up{ 95 };
+		check_stats(stats, 1, 0, 0, 0, 0);
+		akt::uniform_ptr<int> p{ std::move(up) };
+		check_stats(stats, 2, 0, 0, 0, 0);
+	}
+	{
+		AllocatorStats allocStats;
+		StatsCounter stats;
+		akt::uniform_ptr<int> p{ std::allocator_arg, CountingAllocator<int>(allocStats), 96 };
+		check_stats(stats, 1, 0, 0, 0, 0);
+	}
+	{
+		StatsCounter stats;
+		akt::uniform_ptr<IntValue> p = akt::make_uniform<IntValue, IntPinned>(97);
+		check_stats(stats, 1, 0, 0, 0, 0);
+	}
+
+	{
+		// sharing touches the count through one indirect call, moving does not touch it at all
+		akt::uniform_ptr<IntValue> p1{ IntNonCopyable(98) };
+		StatsCounter stats;
+		akt::uniform_ptr<IntValue> p2{ p1 };
+		check_stats(stats, 0, 0, 1, 0, 1);
+		akt::uniform_ptr<IntValue> p3{ std::move(p2) };
+		akt::uniform_ptr<const IntValue> p4{ std::move(p3) };
+		check_stats(stats, 0, 0, 1, 0, 1);
+		BOOST_CHECK_EQUAL(2, p4.use_count());
+		check_stats(stats, 0, 0, 1, 0, 2);
+	}
+	{
+		auto p1 = std::make_unique<akt::uniform_ptr<int>>(99);
+		akt::uniform_ptr<int> p2{ *p1 };
+		StatsCounter stats;
+		p1.reset();
+		check_stats(stats, 0, 0, 0, 1, 1);
+		p2 = nullptr;
+		// the release, then the destruction of the block
+		check_stats(stats, 0, 1, 0, 2, 3);
+	}
+	{
+		auto up = std::make_unique<int>(100);
+		akt::uniform_unique_ptr<int> p{ std::move(up) };
+		StatsCounter stats;
+		p = nullptr;
+		check_stats(stats, 0, 1, 0, 0, 1);
+	}
+
+	{
+		// inline values go through their operations, but never allocate or count
+		StatsCounter stats;
+		inline_ptr p1{ 101 };
+		check_stats(stats, 0, 0, 0, 0, 0);
+		inline_ptr p2{ p1 };
+		check_stats(stats, 0, 0, 0, 0, 1);
+		inline_ptr p3{ std::move(p2) };
+		check_stats(stats, 0, 0, 0, 0, 2);
+		p1 = nullptr;
+		check_stats(stats, 0, 0, 0, 0, 3);
+	}
+}
+
+#ifdef __cpp_constinit
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_constinit)
+{
+	BOOST_CHECK_EQUAL(false, (bool)g_nullPtr);
+	BOOST_CHECK(g_intPtr.get() == &g_constValue);
+	BOOST_CHECK_EQUAL(6, g_basePtr->getInt());
+	BOOST_CHECK_EQUAL(5, *g_inlinePtr);
+	BOOST_CHECK_EQUAL(0, g_inlinePtr.use_count());
+	BOOST_CHECK(g_uniquePtr.get() == &g_constValue);
+	BOOST_CHECK_EQUAL(false, g_uniquePtr.owns());
+	BOOST_CHECK(g_ptrTable[0].get() == &g_constValue);
+	BOOST_CHECK(g_ptrTable[1].get() == nullptr);
+
+	// still a regular handle afterwards
+	g_intPtr = 7;
+	BOOST_CHECK_EQUAL(7, *g_intPtr);
+	g_intPtr = &g_constValue;
+	BOOST_CHECK_EQUAL(5, *g_intPtr);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(test_atomic_uniform_ptr_operations)
+{
+	int i = 110;
+	akt::atomic_uniform_ptr<IntValue> a;
+	BOOST_CHECK(nullptr == a.load().get());
+
+	a.store(IntNonCopyable(111));
+	akt::uniform_ptr<IntValue> p1 = a.load();
+	BOOST_CHECK_EQUAL(111, p1->getInt());
+	BOOST_CHECK_EQUAL(2, p1.use_count());
+
+	akt::uniform_ptr<IntValue> p2 = a.exchange(IntNonMovable(112));
+	BOOST_CHECK(p1.get() == p2.get());
+	BOOST_CHECK_EQUAL(2, p1.use_count());
+	BOOST_CHECK_EQUAL(112, a.load()->getInt());
+
+	// fails against the replaced object and hands out the current one
+	akt::uniform_ptr<IntValue> expected = p1;
+	BOOST_CHECK_EQUAL(false, a.compare_exchange(expected, IntNonCopyable(113)));
+	BOOST_CHECK_EQUAL(112, expected->getInt());
+	BOOST_CHECK_EQUAL(112, a.load()->getInt());
+	BOOST_CHECK(a.compare_exchange(expected, IntNonCopyable(114)));
+	BOOST_CHECK_EQUAL(114, a.load()->getInt());
+	BOOST_CHECK_EQUAL(1, expected.use_count());
+
+	akt::atomic_uniform_ptr<const int> c{ akt::uniform_ptr<const int>{ &i } };
+	BOOST_CHECK(&i == c.load().get());
+	BOOST_CHECK_EQUAL(0, c.load().use_count());
+	c.store(nullptr);
+	BOOST_CHECK(nullptr == c.load().get());
+	akt::uniform_ptr<const int> empty;
+	BOOST_CHECK(c.compare_exchange(empty, &i));
+	BOOST_CHECK(&i == c.load().get());
+}
+
+// a configuration that checks it is read only while it is alive
+struct Config {
+	static constexpr int kAlive = 0x5eed;
+
+	explicit Config(int a_version) : m_version(a_version), m_twice(a_version * 2) { ++s_alive; }
+	Config(const Config&) = delete;
+	Config& operator=(const Config&) = delete;
+	~Config()
+	{
+		m_state = 0;
+		--s_alive;
+	}
+
+	bool valid() const { return m_state == kAlive && m_twice == m_version * 2; }
+
+	static std::atomic<int> s_alive;
+	int m_state = kAlive;
+	int m_version;
+	int m_twice;
+};
+
+std::atomic<int> Config::s_alive{ 0 };
+
+BOOST_AUTO_TEST_CASE(test_atomic_uniform_ptr_stress)
+{
+	constexpr int kReaders = 4;
+	constexpr int kVersions = 2000;
+	{
+		akt::atomic_uniform_ptr<const Config> config{ akt::make_uniform<const Config, Config>(0) };
+		std::atomic<bool> done{ false };
+		std::atomic<int> invalid{ 0 };
+		std::atomic<int> backwards{ 0 };
+		std::vector<std::thread> readers;
+		for (int r = 0; r < kReaders; ++r)
+		{
+			readers.emplace_back([&]() {
+				int last = 0;
+				while (done.load() == false)
+				{
+					// a handle kept across the writes keeps its version alive
+					const akt::uniform_ptr<const Config> current = config.load();
+					for (int k = 0; k < 8; ++k)
+					{
+						if (current->valid() == false)
+						{
+							++invalid;
+						}
+					}
+					if (current->m_version < last)
+					{
+						++backwards;
+					}
+					last = current->m_version;
+				}
+			});
+		}
+
+		std::thread writer([&]() {
+			for (int v = 1; v <= kVersions; ++v)
+			{
+				switch (v % 3)
+				{
+				case 0:
+					config.store(akt::make_uniform<const Config, Config>(v));
+					break;
+				case 1:
+					config.exchange(std::make_shared<Config>(v));
+					break;
+				default:
+					{
+						akt::uniform_ptr<const Config> expected = config.load();
+						while (config.compare_exchange(expected, std::make_unique<Config>(v)) == false)
+						{
+						}
+					}
+					break;
+				}
+				if (v % 64 == 0)
+				{
+					// lets the readers in on a single core
+					std::this_thread::yield();
+				}
+			}
+			done = true;
+		});
+		writer.join();
+		for (auto& reader : readers)
+		{
+			reader.join();
+		}
+		BOOST_CHECK_EQUAL(0, invalid.load());
+		BOOST_CHECK_EQUAL(0, backwards.load());
+		BOOST_CHECK_EQUAL(kVersions, config.load()->m_version);
+		BOOST_CHECK_EQUAL(1, Config::s_alive.load());
+	}
+	BOOST_CHECK_EQUAL(0, Config::s_alive.load());
+}
+
+// records the thread which destroyed it
+struct DestroyedOn {
+	explicit DestroyedOn(std::thread::id* a_thread) : m_thread(a_thread) {}
+	DestroyedOn(const DestroyedOn&) = delete;
+	DestroyedOn& operator=(const DestroyedOn&) = delete;
+	~DestroyedOn() { *m_thread = std::this_thread::get_id(); }
+
+	std::thread::id* m_thread;
+	akt::uniform_ptr<DestroyedOn, akt::deferred_policy<>> m_next; // released when this one is destroyed
+};
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_deferred_policy)
+{
+	using deferred_ptr = akt::uniform_ptr<DestroyedOn, akt::deferred_policy<>>;
+	akt::reclamation_domain& domain = akt::reclamation_domain::global();
+	domain.reclaim();
+	const std::thread::id none;
+	std::thread::id first, second;
+	{
+		deferred_ptr p1{ std::in_place_type<DestroyedOn>, &first };
+		p1->m_next = deferred_ptr{ std::in_place_type<DestroyedOn>, &second };
+		deferred_ptr p2{ p1 };
+		p1 = nullptr;
+		p2 = nullptr;
+		BOOST_CHECK(none == first);
+	}
+	// the object released by a reclaimed one goes in the same batch
+	BOOST_CHECK_EQUAL(2u, domain.reclaim());
+	BOOST_CHECK(std::this_thread::get_id() == first);
+	BOOST_CHECK(std::this_thread::get_id() == second);
+	BOOST_CHECK_EQUAL(0u, domain.reclaim());
+
+	// every source of ownership is deferred, values stored in place are not
+	int destroyed = 0;
+	struct Flag {
+		int* m_destroyed;
+		~Flag() { ++*m_destroyed; }
+	};
+	deferred_ptr{ std::in_place_type<DestroyedOn>, &first };
+	akt::uniform_ptr<Flag, akt::deferred_policy<>>{ std::make_shared<Flag>(Flag{ &destroyed }) };
+	akt::uniform_ptr<Flag, akt::deferred_policy<>>{ std::make_unique<Flag>(Flag{ &destroyed }) };
+	destroyed = 0;
+	akt::uniform_ptr<Flag, akt::inline_policy<sizeof(Flag), alignof(Flag), akt::deferred_policy<>>>{ Flag{ &destroyed } };
+	BOOST_CHECK_EQUAL(2, destroyed);
+	BOOST_CHECK_EQUAL(3u, domain.reclaim());
+	BOOST_CHECK_EQUAL(4, destroyed);
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_deferred_reclaimer)
+{
+	struct Reclaimed {
+		explicit Reclaimed(std::atomic<bool>* a_done) : m_done(a_done) {}
+		~Reclaimed() { *m_done = true; }
+		std::atomic<bool>* m_done;
+	};
+
+	akt::reclamation_domain& domain = akt::reclamation_domain::global();
+	std::atomic<bool> done{ false };
+	domain.start_reclaimer(std::chrono::milliseconds(1));
+	std::thread([&]() { akt::uniform_ptr<Reclaimed, akt::deferred_policy<>> p{ std::in_place_type<Reclaimed>, &done }; }).join();
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (done.load() == false && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	BOOST_CHECK(done.load());
+	domain.stop_reclaimer();
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_weak_ptr)
+{
+	akt::uniform_weak_ptr<IntValue> empty;
+	BOOST_CHECK(empty.expired());
+	BOOST_CHECK(nullptr == empty.lock().get());
+
+	// values owned by the handles
+	akt::uniform_weak_ptr<IntValue> weak;
+	{
+		akt::uniform_ptr<IntValue> p{ IntNonCopyable(120) };
+		weak = p;
+		BOOST_CHECK_EQUAL(false, weak.expired());
+		BOOST_CHECK_EQUAL(1, p.use_count());
+		akt::uniform_ptr<IntValue> locked = weak.lock();
+		BOOST_CHECK(p.get() == locked.get());
+		BOOST_CHECK_EQUAL(2, p.use_count());
+	}
+	BOOST_CHECK(weak.expired());
+	BOOST_CHECK(nullptr == weak.lock().get());
+
+	// the shared_ptr is released with the last handle, not with the last observer
+	auto shared = std::make_shared<IntNonCopyable>(121);
+	std::weak_ptr<IntNonCopyable> original = shared;
+	akt::uniform_ptr<IntValue> fromShared{ std::move(shared) };
+	akt::uniform_weak_ptr<const IntValue> weakShared{ fromShared };
+	BOOST_CHECK_EQUAL(121, weakShared.lock()->getInt());
+	fromShared = nullptr;
+	BOOST_CHECK(original.expired());
+	BOOST_CHECK(weakShared.expired());
+
+	// the block holding the shared_ptr is observed, not the object: other shared_ptr owners don't keep it alive
+	auto owner = std::make_shared<IntNonCopyable>(124);
+	akt::uniform_ptr<IntValue> fromOwner{ owner };
+	akt::uniform_weak_ptr<IntValue> weakOwner{ fromOwner };
+	BOOST_CHECK_EQUAL(2, owner.use_count());
+	fromOwner = nullptr;
+	BOOST_CHECK(weakOwner.expired());
+	BOOST_CHECK(nullptr == weakOwner.lock().get());
+	BOOST_CHECK_EQUAL(1, owner.use_count());
+	BOOST_CHECK_EQUAL(124, owner->getInt());
+
+	// a unique_ptr as well
+	int destroyed = 0;
+	struct Flag {
+		int* m_destroyed;
+		~Flag() { ++*m_destroyed; }
+	};
+	akt::uniform_ptr<Flag> fromUnique{ std::make_unique<Flag>(Flag{ &destroyed }) };
+	destroyed = 0;
+	akt::uniform_weak_ptr<Flag> weakUnique{ fromUnique };
+	fromUnique = nullptr;
+	BOOST_CHECK_EQUAL(1, destroyed);
+	BOOST_CHECK(nullptr == weakUnique.lock().get());
+
+	// raw pointers are always alive
+	IntNonCopyable raw(122);
+	akt::uniform_weak_ptr<IntValue> weakRaw{ akt::uniform_ptr<IntValue>{ &raw } };
+	BOOST_CHECK_EQUAL(false, weakRaw.expired());
+	BOOST_CHECK(&raw == weakRaw.lock().get());
+	BOOST_CHECK_EQUAL(0, weakRaw.lock().use_count());
+
+	// converted to a base, the adjusted pointer is kept
+	akt::uniform_ptr<IntTagged> tagged{ IntTagged(123) };
+	akt::uniform_weak_ptr<IntTagged> weakTagged{ tagged };
+	akt::uniform_weak_ptr<IntValue> weakBase{ weakTagged };
+	BOOST_CHECK(static_cast<IntValue*>(tagged.get()) == weakBase.lock().get());
+	tagged = nullptr;
+	BOOST_CHECK(weakBase.expired());
+	BOOST_CHECK(akt::uniform_weak_ptr<IntValue>{ weakTagged }.expired());
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_weak_ptr_memory)
+{
+	{
+		// the value shares the allocation with the counters, it is destroyed first and freed with the last observer
+		struct Flag {
+			explicit Flag(int* a_destroyed) : m_destroyed(a_destroyed) {}
+			~Flag() { ++*m_destroyed; }
+			int* m_destroyed;
+		};
+		int destroyed = 0;
+		akt::uniform_ptr<Flag> p{ std::in_place_type<Flag>, &destroyed };
+		akt::uniform_weak_ptr<Flag> weak{ p };
+		StatsCounter stats;
+		p = nullptr;
+		BOOST_CHECK_EQUAL(1, destroyed);
+		BOOST_CHECK_EQUAL(0u, stats.count().deallocations);
+		weak = nullptr;
+		BOOST_CHECK_EQUAL(1u, stats.count().deallocations);
+	}
+	{
+		// observers and locks of other threads while the last owner goes away
+		for (int round = 0; round < 100; ++round)
+		{
+			akt::uniform_ptr<int> p{ round };
+			akt::uniform_weak_ptr<int> weak{ p };
+			std::atomic<int> wrong{ 0 };
+			std::thread observer([&]() {
+				for (int i = 0; i < 100; ++i)
+				{
+					const akt::uniform_ptr<int> locked = weak.lock();
+					if (locked && *locked != round)
+					{
+						++wrong;
+					}
+				}
+			});
+			p = nullptr;
+			observer.join();
+			BOOST_CHECK_EQUAL(0, wrong.load());
+			BOOST_CHECK(weak.expired());
+		}
+	}
+}
+
+// counts its owners itself
+class IntCounted : public IntValue {
+public:
+	explicit IntCounted(int a_value, int* a_destroyed) : m_value(a_value), m_destroyed(a_destroyed) {}
+	~IntCounted() { ++*m_destroyed; }
+
+	int getInt() const override { return m_value; }
+	void setInt(int val) override { m_value = val; }
+
+	friend void add_ref(IntCounted* a_obj) { ++a_obj->m_refs; }
+	friend void release(IntCounted* a_obj)
+	{
+		if (--a_obj->m_refs == 0)
+		{
+			delete a_obj;
+		}
+	}
+	friend long use_count(const IntCounted* a_obj) { return a_obj->m_refs; }
+private:
+	int m_value;
+	int* m_destroyed;
+	long m_refs = 0;
+};
+
+// counted the way boost::intrusive_ptr expects
+struct BoostCounted {
+	explicit BoostCounted(int* a_destroyed) : m_destroyed(a_destroyed) {}
+	~BoostCounted() { ++*m_destroyed; }
+	int* m_destroyed;
+	int m_refs = 0;
+};
+
+void intrusive_ptr_add_ref(BoostCounted* a_obj) { ++a_obj->m_refs; }
+void intrusive_ptr_release(BoostCounted* a_obj)
+{
+	if (--a_obj->m_refs == 0)
+	{
+		delete a_obj;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_intrusive)
+{
+	int destroyed = 0;
+	IntCounted* const obj = new IntCounted(130, &destroyed);
+	{
+		// no block, the copies count on the object
+		AllocationCounter allocs;
+		StatsCounter stats;
+		akt::uniform_ptr<IntValue> p1{ akt::intrusive, obj };
+		BOOST_CHECK_EQUAL(0u, allocs.count());
+		BOOST_CHECK(static_cast<IntValue*>(obj) == p1.get());
+		BOOST_CHECK_EQUAL(1, p1.use_count());
+		akt::uniform_ptr<const IntValue> p2{ p1 };
+		BOOST_CHECK_EQUAL(2, p2.use_count());
+		check_stats(stats, 0, 0, 2, 0, 3);
+		BOOST_CHECK_EQUAL(130, p2->getInt());
+
+		akt::uniform_ptr<IntCounted> p3{ akt::intrusive, obj };
+		BOOST_CHECK_EQUAL(3, p3.use_count());
+		p1 = nullptr;
+		p3 = nullptr;
+		BOOST_CHECK_EQUAL(0, destroyed);
+		BOOST_CHECK_EQUAL(0u, allocs.count());
+
+		// can't be observed
+		akt::uniform_weak_ptr<const IntValue> weak{ p2 };
+		BOOST_CHECK(weak.expired());
+		BOOST_CHECK(nullptr == weak.lock().get());
+	}
+	BOOST_CHECK_EQUAL(1, destroyed);
+
+	// adopts the reference of the caller
+	IntCounted* const adopted = new IntCounted(131, &destroyed);
+	add_ref(adopted);
+	{
+		akt::uniform_ptr<IntValue> p{ akt::intrusive, adopted, false };
+		BOOST_CHECK_EQUAL(1, p.use_count());
+	}
+	BOOST_CHECK_EQUAL(2, destroyed);
+
+	destroyed = 0;
+	{
+		akt::uniform_ptr<BoostCounted> p1{ akt::intrusive, new BoostCounted(&destroyed) };
+		akt::uniform_ptr<BoostCounted> p2{ p1 };
+		BOOST_CHECK_EQUAL(2, p1->m_refs);
+		BOOST_CHECK_EQUAL(-1, p1.use_count());
+		akt::uniform_ptr<BoostCounted> nothing{ akt::intrusive, static_cast<BoostCounted*>(nullptr) };
+		BOOST_CHECK(nullptr == nothing.get());
+		BOOST_CHECK_EQUAL(0, nothing.use_count());
+	}
+	BOOST_CHECK_EQUAL(1, destroyed);
+}
+
+// a pool of values handed out by move-only handles, which return their slot when they are destroyed
+class IntPool {
+public:
+	class Handle {
+	public:
+		Handle(IntPool* a_pool, int a_slot) : m_pool(a_pool), m_slot(a_slot) {}
+		Handle(Handle&& rhv) noexcept : m_pool(std::exchange(rhv.m_pool, nullptr)), m_slot(rhv.m_slot) {}
+		Handle(const Handle&) = delete;
+		Handle& operator=(const Handle&) = delete;
+		~Handle()
+		{
+			if (m_pool != nullptr)
+			{
+				m_pool->m_used[m_slot] = false;
+			}
+		}
+
+		IntNonCopyable* get() const { return m_pool != nullptr ? &m_pool->m_values[m_slot] : nullptr; }
+	private:
+		IntPool* m_pool;
+		int m_slot;
+	};
+
+	Handle take(int a_slot, int a_value)
+	{
+		m_used[a_slot] = true;
+		m_values[a_slot].setInt(a_value);
+		return Handle(this, a_slot);
+	}
+	bool used(int a_slot) const { return m_used[a_slot]; }
+private:
+	IntNonCopyable m_values[2] = { IntNonCopyable(0), IntNonCopyable(0) };
+	bool m_used[2] = { false, false };
+};
+
+namespace akt {
+
+template<>
+struct uniform_source_traits<IntPool::Handle> {
+	using element_type = IntNonCopyable;
+	static constexpr uniform_source_kind kind = uniform_source_kind::kept;
+	static IntNonCopyable* get(const IntPool::Handle& src) noexcept { return src.get(); }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(test_uniform_ptr_source_traits)
+{
+	{
+		// borrowed, nothing is allocated or counted
+		IntNonCopyable value(140);
+		AllocationCounter allocs;
+		akt::uniform_ptr<IntValue> p1{ std::ref(value) };
+		akt::uniform_ptr<const IntValue> p2{ std::cref(value) };
+		BOOST_CHECK_EQUAL(0u, allocs.count());
+		BOOST_CHECK(&value == p1.get());
+		BOOST_CHECK(&value == p2.get());
+		BOOST_CHECK_EQUAL(0, p1.use_count());
+	}
+	{
+		// the value of an optional is taken like any other value
+		Counted::s_copies = 0;
+		Counted::s_moves = 0;
+		std::optional<Counted> value{ std::in_place, 141 };
+		AllocationCounter heap;
+		akt::uniform_ptr<Counted> p1{ value };
+		BOOST_CHECK_EQUAL(1u, heap.count());
+		BOOST_CHECK_EQUAL(1, Counted::s_copies);
+		akt::uniform_ptr<Counted> p2{ std::move(value) };
+		BOOST_CHECK_EQUAL(1, Counted::s_moves);
+		BOOST_CHECK(&*value != p1.get() && p1.get() != p2.get());
+		BOOST_CHECK_EQUAL(141, p2->m_value);
+		BOOST_CHECK(nullptr == akt::uniform_ptr<Counted>{ std::optional<Counted>() }.get());
+
+		// the value of a const optional is taken as const
+		const std::optional<Counted> constant{ std::in_place, 144 };
+		akt::uniform_ptr<const Counted> p3{ constant };
+		BOOST_CHECK_EQUAL(2, Counted::s_copies);
+		BOOST_CHECK_EQUAL(144, p3->m_value);
+		static_assert(!std::is_constructible_v<akt::uniform_ptr<Counted>, const std::optional<Counted>&>);
+		static_assert(std::is_constructible_v<akt::uniform_ptr<const Counted>, std::optional<Counted>&>);
+
+		AllocationCounter allocs;
+		akt::uniform_ptr<int, akt::inline_policy<sizeof(int)>> inlined{ std::optional<int>(142) };
+		BOOST_CHECK_EQUAL(0u, allocs.count());
+		BOOST_CHECK_EQUAL(142, *inlined);
+	}
+	{
+		// a kept handle goes into the one block the copies share
+		IntPool pool;
+		AllocationCounter allocs;
+		akt::uniform_ptr<IntValue> p1{ pool.take(0, 143) };
+		BOOST_CHECK_EQUAL(1u, allocs.count());
+		akt::uniform_ptr<IntValue> p2{ p1 };
+		BOOST_CHECK_EQUAL(143, p2->getInt());
+		BOOST_CHECK_EQUAL(2, p2.use_count());
+		p1 = nullptr;
+		BOOST_CHECK(pool.used(0));
+		p2 = nullptr;
+		BOOST_CHECK_EQUAL(false, pool.used(0));
+		BOOST_CHECK_EQUAL(1u, allocs.count());
+
+		akt::uniform_weak_ptr<IntValue> weak;
+		{
+			akt::uniform_ptr<IntValue> p{ pool.take(1, 144) };
+			weak = p;
+		}
+		BOOST_CHECK_EQUAL(false, pool.used(1));
+		BOOST_CHECK(weak.expired());
+	}
+	static_assert(!std::is_constructible_v<akt::uniform_ptr<IntValue>, std::optional<int>>);
+	static_assert(!std::is_constructible_v<akt::uniform_ptr<IntValue>, std::reference_wrapper<int>>);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "uniform_ptr.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace akt {
+
+namespace detail {
+
+// counts the threads inside a read, spread over cache lines so that readers of different threads don't share one
+class reader_indicator {
+public:
+	static constexpr std::size_t stripes = 8;
+
+	// returns the stripe to depart from
+	std::size_t arrive() noexcept
+	{
+		const std::size_t stripe = this_thread_stripe();
+		mStripes[stripe].readers.fetch_add(1, std::memory_order_seq_cst);
+		return stripe;
+	}
+	void depart(std::size_t stripe) noexcept { mStripes[stripe].readers.fetch_sub(1, std::memory_order_release); }
+
+	bool empty() const noexcept
+	{
+		for (const auto& stripe : mStripes)
+		{
+			if (stripe.readers.load(std::memory_order_seq_cst) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+private:
+	struct alignas(64) stripe {
+		std::atomic<long> readers{ 0 };
+	};
+
+	static std::size_t this_thread_stripe() noexcept
+	{
+		static std::atomic<std::size_t> next{ 0 };
+		thread_local const std::size_t stripe = next.fetch_add(1, std::memory_order_relaxed) % stripes;
+		return stripe;
+	}
+
+	stripe mStripes[stripes];
+};
+
+}
+
+// a uniform_ptr which threads may load and replace concurrently.
+// load() never blocks and finishes in a bounded number of steps, whatever the other threads do;
+// store(), exchange() and compare_exchange() are serialized and wait until the readers of the replaced handle
+// are done with it, so what it owned is released by the writer, never under a reader
+template<typename T, typename Policy = default_policy>
+class atomic_uniform_ptr {
+	// deferred_policy<single_thread_rc> and the like wrap the counter of their base, so derived counters are checked too
+	static_assert(!std::is_base_of_v<detail::plain_counter, typename Policy::counter_type>, "handles loaded by other threads need an atomic counter");
+	// a loaded copy of a value stored in place is a value of its own, which compare_exchange could never match
+	static_assert(Policy::inline_size == 0, "values stored in place can't be compared by identity");
+public:
+	using value_type = uniform_ptr<T, Policy>;
+
+	atomic_uniform_ptr() noexcept = default;
+	atomic_uniform_ptr(std::nullptr_t) noexcept {}
+	explicit atomic_uniform_ptr(value_type desired) : mHandle(make_handle(std::move(desired))) {}
+	atomic_uniform_ptr(const atomic_uniform_ptr&) = delete;
+	atomic_uniform_ptr& operator=(const atomic_uniform_ptr&) = delete;
+	~atomic_uniform_ptr() { delete_handle(mHandle.load(std::memory_order_relaxed)); }
+
+	// a copy of the current handle, shares the ownership with it
+	value_type load() const
+	{
+		const unsigned version = mVersion.load(std::memory_order_seq_cst);
+		const read_guard guard{ mReaders[version], mReaders[version].arrive() };
+		const value_type* const handle = mHandle.load(std::memory_order_seq_cst);
+		return handle != nullptr ? value_type(*handle) : value_type();
+	}
+
+	void store(value_type desired)
+	{
+		exchange(std::move(desired));
+	}
+
+	// returns the replaced handle
+	value_type exchange(value_type desired)
+	{
+		std::unique_ptr<value_type, handle_deleter> old;
+		{
+			std::lock_guard<std::mutex> lock(mWriter);
+			old.reset(replace(make_handle(std::move(desired))));
+		}
+		return old != nullptr ? std::move(*old) : value_type();
+	}
+
+	// replaces the handle if it points to the same object as expected, otherwise loads it into expected
+	bool compare_exchange(value_type& expected, value_type desired)
+	{
+		std::unique_ptr<value_type, handle_deleter> old;
+		{
+			std::lock_guard<std::mutex> lock(mWriter);
+			// the writers are the only ones who free handles
+			const value_type* const current = mHandle.load(std::memory_order_relaxed);
+			const T* const pointer = current != nullptr ? current->get() : nullptr;
+			if (pointer != expected.get())
+			{
+				expected = current != nullptr ? *current : value_type();
+				return false;
+			}
+			old.reset(replace(make_handle(std::move(desired))));
+		}
+		return true;
+	}
+private:
+	struct handle_deleter {
+		void operator()(value_type* handle) const noexcept { delete_handle(handle); }
+	};
+
+	struct read_guard {
+		detail::reader_indicator& readers;
+		std::size_t stripe;
+		~read_guard() { readers.depart(stripe); }
+	};
+
+	// every stored handle gets an allocation of its own, readers copy it in place
+	static value_type* make_handle(value_type&& desired)
+	{
+		if (!desired)
+		{
+			return nullptr;
+		}
+		AKT_UNIFORM_PTR_COUNT(allocations);
+		return new value_type(std::move(desired));
+	}
+
+	static void delete_handle(value_type* handle) noexcept
+	{
+		if (handle != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(deallocations);
+			delete handle;
+		}
+	}
+
+	// mWriter is held; returns the old handle, which no reader uses any more.
+	// Readers count themselves in the indicator of the version they saw: the writer first waits for the stragglers
+	// of the other version, switches the new readers over to it and waits for the readers of the current one
+	value_type* replace(value_type* desired) noexcept
+	{
+		value_type* const old = mHandle.exchange(desired, std::memory_order_seq_cst);
+		const unsigned current = mVersion.load(std::memory_order_relaxed);
+		const unsigned next = current ^ 1;
+		wait_for_readers(mReaders[next]);
+		mVersion.store(next, std::memory_order_seq_cst);
+		wait_for_readers(mReaders[current]);
+		return old;
+	}
+
+	static void wait_for_readers(const detail::reader_indicator& readers) noexcept
+	{
+		while (readers.empty() == false)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	std::atomic<value_type*> mHandle{ nullptr };
+	std::atomic<unsigned> mVersion{ 0 };
+	mutable detail::reader_indicator mReaders[2];
+	std::mutex mWriter;
+};
+
+}
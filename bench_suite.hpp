@@ -0,0 +1,206 @@
+#pragma once
+
+// Timing and JSON reporting shared by the benchmark programs.
+// Results are printed as JSON, to stdout or to the file given by --out=<path>; --filter=<text> runs matching benchmarks only.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+constexpr std::size_t kRounds = 200;
+constexpr std::size_t kRepetitions = 5;
+
+#if !defined(__GNUC__)
+inline const void* volatile g_sink = nullptr;
+#endif
+
+// forces the value to be computed and kept in memory
+template<typename T>
+void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	g_sink = &value;
+	_ReadWriteBarrier();
+#endif
+}
+
+struct Result {
+	std::string name;
+	std::size_t ops = 0;
+	double min_ns = 0;
+	double median_ns = 0;
+};
+
+struct Comparison {
+	std::string baseline;
+	std::string candidate;
+	double speedup = 0; // median of baseline / median of candidate
+};
+
+class Suite {
+public:
+	explicit Suite(std::string a_filter) : m_filter(std::move(a_filter)) {}
+
+	// printed in the "context" object of the report
+	void add_context(std::string key, std::size_t value) { m_context.emplace_back(std::move(key), value); }
+
+	// calls prepare() and then times body(), which does ops operations, kRounds times per repetition
+	template<typename Prepare, typename Body>
+	void measure(const std::string& name, std::size_t ops, Prepare&& prepare, Body&& body)
+	{
+		if (name.find(m_filter) == std::string::npos)
+		{
+			return;
+		}
+		std::vector<double> samples;
+		for (std::size_t rep = 0; rep < kRepetitions; ++rep)
+		{
+			std::chrono::steady_clock::duration total{};
+			for (std::size_t round = 0; round < kRounds; ++round)
+			{
+				prepare();
+				const auto start = std::chrono::steady_clock::now();
+				body();
+				total += std::chrono::steady_clock::now() - start;
+			}
+			samples.push_back(std::chrono::duration<double, std::nano>(total).count() / static_cast<double>(ops * kRounds));
+		}
+		std::sort(samples.begin(), samples.end());
+		m_results.push_back(Result{ name, ops * kRounds, samples.front(), samples[samples.size() / 2] });
+	}
+
+	template<typename Body>
+	void measure(const std::string& name, std::size_t ops, Body&& body)
+	{
+		measure(name, ops, []() {}, std::forward<Body>(body));
+	}
+
+	// printed in the "comparisons" array, how many times faster candidate ran than baseline; skipped unless both ran.
+	// Reported only, a slower candidate does not fail the run
+	void compare(const std::string& baseline, const std::string& candidate)
+	{
+		const Result* base = find(baseline);
+		const Result* cand = find(candidate);
+		if (base != nullptr && cand != nullptr && cand->median_ns > 0)
+		{
+			m_comparisons.push_back(Comparison{ baseline, candidate, base->median_ns / cand->median_ns });
+		}
+	}
+
+	void write_json(std::ostream& out) const
+	{
+		out << "{\n  \"context\": {\n";
+		out << "    \"compiler\": \"" << compiler() << "\",\n";
+		for (const auto& entry : m_context)
+		{
+			out << "    \"" << entry.first << "\": " << entry.second << ",\n";
+		}
+		out << "    \"rounds\": " << kRounds << ",\n";
+		out << "    \"repetitions\": " << kRepetitions << "\n";
+		out << "  },\n  \"benchmarks\": [";
+		for (std::size_t i = 0; i < m_results.size(); ++i)
+		{
+			const Result& r = m_results[i];
+			char line[512];
+			std::snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"ops\": %zu, \"min_ns_per_op\": %.3f, \"median_ns_per_op\": %.3f}",
+				i == 0 ? "" : ",", r.name.c_str(), r.ops, r.min_ns, r.median_ns);
+			out << line;
+		}
+		out << "\n  ],\n  \"comparisons\": [";
+		for (std::size_t i = 0; i < m_comparisons.size(); ++i)
+		{
+			const Comparison& c = m_comparisons[i];
+			char line[512];
+			std::snprintf(line, sizeof(line), "%s\n    {\"baseline\": \"%s\", \"candidate\": \"%s\", \"speedup\": %.3f}",
+				i == 0 ? "" : ",", c.baseline.c_str(), c.candidate.c_str(), c.speedup);
+			out << line;
+		}
+		out << "\n  ]\n}\n";
+	}
+private:
+	const Result* find(const std::string& name) const
+	{
+		for (const auto& result : m_results)
+		{
+			if (result.name == name)
+			{
+				return &result;
+			}
+		}
+		return nullptr;
+	}
+
+	static std::string compiler()
+	{
+#if defined(__clang__)
+		return "clang " __clang_version__;
+#elif defined(__GNUC__)
+		return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+		return "msvc " + std::to_string(_MSC_VER);
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string m_filter;
+	std::vector<std::pair<std::string, std::size_t>> m_context;
+	std::vector<Result> m_results;
+	std::vector<Comparison> m_comparisons;
+};
+
+// parses the command line, runs run_all(suite) and writes the report; the result of main()
+template<typename RunAll>
+int run_main(int argc, char* argv[], RunAll&& run_all)
+{
+	std::string out;
+	std::string filter;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg.rfind("--out=", 0) == 0)
+		{
+			out = arg.substr(6);
+		}
+		else if (arg.rfind("--filter=", 0) == 0)
+		{
+			filter = arg.substr(9);
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0] << " [--out=<path>] [--filter=<text>]" << std::endl;
+			return 1;
+		}
+	}
+
+	// libstdc++ counts shared_ptr owners without atomics until the program starts a thread
+	std::thread([]() {}).join();
+
+	Suite suite{ filter };
+	run_all(suite);
+	if (out.empty())
+	{
+		suite.write_json(std::cout);
+	}
+	else
+	{
+		std::ofstream file(out, std::ios::trunc);
+		suite.write_json(file);
+	}
+	return 0;
+}
+
+}
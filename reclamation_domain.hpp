@@ -0,0 +1,163 @@
+#pragma once
+
+#include "uniform_ptr.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+namespace akt {
+
+namespace detail {
+
+// a block whose last owner is gone, linked into the queue of reclamation_domain
+struct retired_block {
+	void* block = nullptr;
+	void (*destroy)(void* block) noexcept = nullptr;
+	retired_block* next = nullptr;
+};
+
+// set when the domain is gone at exit, the objects released later are destroyed right away
+inline std::atomic<bool> reclamation_closed{ false };
+
+// counts like Counter, keeps the link of the block for the queue of retired blocks
+template<typename Counter>
+class deferred_counter : public Counter {
+public:
+	using Counter::Counter;
+	void retire(void* block, void (*destroy)(void*) noexcept) noexcept;
+private:
+	retired_block mRetired;
+};
+
+}
+
+// destroys the objects owned through uniform_ptr<T, deferred_policy<>> after their last owner is gone:
+// the thread which releases it only links the block into a lock-free queue, the objects are destroyed in batches
+// by reclaim(), called at quiescent points or by the reclaimer thread, and at the latest when the program exits
+class reclamation_domain {
+public:
+	static reclamation_domain& global()
+	{
+		static reclamation_domain domain;
+		return domain;
+	}
+
+	reclamation_domain(const reclamation_domain&) = delete;
+	reclamation_domain& operator=(const reclamation_domain&) = delete;
+
+	// lock-free
+	void retire(detail::retired_block* retired) noexcept
+	{
+		retired->next = mRetired.load(std::memory_order_relaxed);
+		while (mRetired.compare_exchange_weak(retired->next, retired, std::memory_order_release, std::memory_order_relaxed) == false)
+		{
+		}
+	}
+
+	// destroys what is retired, in the order it was, including what the destroyed objects released; returns how many
+	std::size_t reclaim() noexcept
+	{
+		std::size_t count = 0;
+		while (detail::retired_block* retired = mRetired.exchange(nullptr, std::memory_order_acquire))
+		{
+			detail::retired_block* oldest = nullptr;
+			while (retired != nullptr)
+			{
+				detail::retired_block* const next = retired->next;
+				retired->next = oldest;
+				oldest = retired;
+				retired = next;
+			}
+			while (oldest != nullptr)
+			{
+				detail::retired_block* const next = oldest->next;
+				oldest->destroy(oldest->block);
+				oldest = next;
+				++count;
+			}
+		}
+		return count;
+	}
+
+	// reclaims every period from a thread of its own until stop_reclaimer()
+	void start_reclaimer(std::chrono::milliseconds period)
+	{
+		std::lock_guard<std::mutex> lock(mReclaimerMutex);
+		if (mReclaimer.joinable() == false)
+		{
+			mStopping = false;
+			mReclaimer = std::thread([this, period]() { run_reclaimer(period); });
+		}
+	}
+
+	void stop_reclaimer()
+	{
+		std::thread reclaimer;
+		{
+			std::lock_guard<std::mutex> lock(mReclaimerMutex);
+			mStopping = true;
+			mStop.notify_all();
+			reclaimer = std::move(mReclaimer);
+		}
+		if (reclaimer.joinable() == true)
+		{
+			reclaimer.join();
+		}
+	}
+private:
+	reclamation_domain() = default;
+	~reclamation_domain()
+	{
+		stop_reclaimer();
+		detail::reclamation_closed.store(true, std::memory_order_release);
+		reclaim();
+	}
+
+	void run_reclaimer(std::chrono::milliseconds period)
+	{
+		std::unique_lock<std::mutex> lock(mReclaimerMutex);
+		while (mStop.wait_for(lock, period, [this]() { return mStopping; }) == false)
+		{
+			lock.unlock();
+			reclaim();
+			lock.lock();
+		}
+	}
+
+	std::atomic<detail::retired_block*> mRetired{ nullptr };
+
+	std::mutex mReclaimerMutex;
+	std::condition_variable mStop;
+	bool mStopping = false;
+	std::thread mReclaimer;
+};
+
+// owned objects are destroyed by reclamation_domain::global() instead of the thread which releases the last owner,
+// values stored in place are still destroyed with their handle
+template<typename Base = default_policy>
+struct deferred_policy : Base {
+	using counter_type = detail::deferred_counter<typename Base::counter_type>;
+};
+
+namespace detail {
+
+template<typename Counter>
+void deferred_counter<Counter>::retire(void* block, void (*destroy)(void*) noexcept) noexcept
+{
+	if (reclamation_closed.load(std::memory_order_acquire) == true)
+	{
+		destroy(block);
+		return;
+	}
+	mRetired.block = block;
+	mRetired.destroy = destroy;
+	reclamation_domain::global().retire(&mRetired);
+}
+
+}
+
+}
@@ -2,86 +2,1075 @@
 
 #ifndef _UNIFORM_PTR_HPP_
 
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
 #include <type_traits>
+#include <utility>
 
+// AKT_UNIFORM_PTR_STATS turns on counting of what uniform_ptr operations cost, per thread
+#ifdef AKT_UNIFORM_PTR_STATS
 namespace akt {
 
+struct uniform_ptr_stats {
+	std::size_t allocations = 0;
+	std::size_t deallocations = 0;
+	std::size_t ref_increments = 0;
+	std::size_t ref_decrements = 0;
+	std::size_t indirect_calls = 0; // calls through type-erased operations
+};
+
+inline uniform_ptr_stats& this_thread_uniform_ptr_stats() noexcept
+{
+	thread_local uniform_ptr_stats stats;
+	return stats;
+}
+
+}
+#define AKT_UNIFORM_PTR_COUNT(counter) (++::akt::this_thread_uniform_ptr_stats().counter)
+#else
+#define AKT_UNIFORM_PTR_COUNT(counter) ((void)0)
+#endif
+
+namespace akt {
+
+namespace detail {
+
+// thread-safe reference counter
+class atomic_counter {
+public:
+	using weak_counter = atomic_counter;
+
+	explicit atomic_counter(long value) noexcept : mValue(value) {}
+	void increment() noexcept { mValue.fetch_add(1, std::memory_order_relaxed); }
+	bool increment_if_not_zero() noexcept
+	{
+		long value = mValue.load(std::memory_order_relaxed);
+		while (value != 0)
+		{
+			if (mValue.compare_exchange_weak(value, value + 1, std::memory_order_relaxed))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+	long decrement() noexcept { return mValue.fetch_sub(1, std::memory_order_acq_rel) - 1; }
+	long load() const noexcept { return mValue.load(std::memory_order_relaxed); }
+private:
+	std::atomic<long> mValue;
+};
+
+// reference counter for objects which never cross threads
+class plain_counter {
+public:
+	using weak_counter = plain_counter;
+
+	explicit plain_counter(long value) noexcept : mValue(value) {}
+	void increment() noexcept { ++mValue; }
+	bool increment_if_not_zero() noexcept { return mValue != 0 ? (++mValue, true) : false; }
+	long decrement() noexcept { return --mValue; }
+	long load() const noexcept { return mValue; }
+private:
+	long mValue;
+};
+
+}
+
+// owned values are always allocated on the heap and are shared between copies of uniform_ptr,
+// the number of owners is counted atomically
+struct default_policy {
+	using counter_type = detail::atomic_counter;
+	static constexpr std::size_t inline_size = 0;
+	static constexpr std::size_t inline_align = alignof(void*);
+};
+
+// the number of owners is counted with plain increments: all copies of a handle have to stay in one thread
+struct single_thread_rc : default_policy {
+	using counter_type = detail::plain_counter;
+};
+
+// owned values which fit into Size bytes with alignment up to Align are stored inside the uniform_ptr itself.
+// Such a value is deep-copied when the uniform_ptr is copied, so every copy owns its own value.
+// Values which don't fit, aren't copyable or may throw on move fall back to the shared heap storage of Base.
+template<std::size_t Size, std::size_t Align = alignof(std::max_align_t), typename Base = default_policy>
+struct inline_policy : Base {
+	static constexpr std::size_t inline_size = Size;
+	static constexpr std::size_t inline_align = Align;
+};
+
+// selects the constructor of uniform_ptr which shares the ownership of an intrusively counted object
+struct intrusive_t {
+	explicit intrusive_t() = default;
+};
+inline constexpr intrusive_t intrusive{};
+
+// how uniform_ptr takes over the object of a source
+enum class uniform_source_kind {
+	borrowed, // the object outlives every copy of the handle, the source is dropped
+	kept, // the source keeps the object alive, it is moved into the block the copies share
+	value // the object is a value inside the source, it is moved or copied out like any value
+};
+
+// makes a pointer-like type a source of uniform_ptr. A specialization has
+//   using element_type = ...;
+//   static constexpr uniform_source_kind kind = ...;
+//   static element_type* get(const Src& src) noexcept; // the object, nullptr for none
+// A value source overloads get() for Src& and const Src& instead, the latter returns a const element_type*,
+// so that the value of a const source goes to uniform_ptr<const T> only.
+// A borrowed source costs no allocation; a kept one costs one block with the source in it, as std::shared_ptr does;
+// a value is owned as any other value, in one block under default_policy or in place under inline_policy if it fits
+template<typename Src, typename = void>
+struct uniform_source_traits {};
+
+template<typename U>
+struct uniform_source_traits<std::reference_wrapper<U>> {
+	using element_type = U;
+	static constexpr uniform_source_kind kind = uniform_source_kind::borrowed;
+	static U* get(const std::reference_wrapper<U>& src) noexcept { return &src.get(); }
+};
+
+template<typename U>
+struct uniform_source_traits<std::optional<U>> {
+	using element_type = U;
+	static constexpr uniform_source_kind kind = uniform_source_kind::value;
+	static U* get(std::optional<U>& src) noexcept { return src.has_value() ? &*src : nullptr; }
+	static const U* get(const std::optional<U>& src) noexcept { return src.has_value() ? &*src : nullptr; }
+};
+
+namespace detail {
+
+template<typename U, typename Policy>
+inline constexpr bool fits_inline_v = sizeof(U) <= Policy::inline_size && alignof(U) <= Policy::inline_align
+	&& std::is_copy_constructible_v<U> && std::is_nothrow_move_constructible_v<U>;
+
+struct inline_ops {
+	void (*copy)(const void* src, void* dst);
+	void (*move)(void* src, void* dst) noexcept; // destroys the source
+	void (*destroy)(void* obj) noexcept;
+};
+
+template<typename U>
+inline constexpr inline_ops inline_ops_for = {
+	[](const void* src, void* dst) { ::new (dst) U(*static_cast<const U*>(src)); },
+	[](void* src, void* dst) noexcept { ::new (dst) U(std::move(*static_cast<U*>(src))); static_cast<U*>(src)->~U(); },
+	[](void* obj) noexcept { static_cast<U*>(obj)->~U(); }
+};
+
+// buffer for the value owned in place, used as a base of uniform_ptr
+template<std::size_t Size, std::size_t Align>
+class inline_storage {
+public:
+	constexpr inline_storage() noexcept : mEmpty() {}
+	inline_storage(const inline_storage& rhv) { copy_from(rhv); }
+	inline_storage(inline_storage&& rhv) noexcept { take(rhv); }
+	inline_storage& operator=(const inline_storage&) = delete;
+	inline_storage& operator=(inline_storage&&) = delete;
+	~inline_storage() { reset(); }
+
+	template<typename U, typename... Args>
+	U* construct(Args&&... args)
+	{
+		U* p = ::new (static_cast<void*>(mBuf)) U(std::forward<Args>(args)...);
+		mOps = &inline_ops_for<U>;
+		return p;
+	}
+
+	void copy_from(const inline_storage& rhv)
+	{
+		if (rhv.mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			rhv.mOps->copy(rhv.mBuf, mBuf);
+			mOps = rhv.mOps;
+		}
+	}
+
+	void take(inline_storage& rhv) noexcept
+	{
+		if (rhv.mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			rhv.mOps->move(rhv.mBuf, mBuf);
+			mOps = std::exchange(rhv.mOps, nullptr);
+		}
+	}
+
+	void reset() noexcept
+	{
+		if (mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			std::exchange(mOps, nullptr)->destroy(mBuf);
+		}
+	}
+
+	bool holds_value() const noexcept { return mOps != nullptr; }
+
+	// maps a pointer into the buffer of 'from' onto the same place of this buffer, the value has to be copied or moved already
+	template<typename P>
+	P* rebase(const inline_storage& from, P* p) const noexcept
+	{
+		if (mOps == nullptr)
+		{
+			return p;
+		}
+		const auto offset = reinterpret_cast<const volatile unsigned char*>(p) - from.mBuf;
+		return reinterpret_cast<P*>(const_cast<unsigned char*>(mBuf) + offset);
+	}
+private:
+	const inline_ops* mOps = nullptr;
+	union {
+		char mEmpty; // lets an empty buffer be constant-initialized
+		alignas(Align) unsigned char mBuf[Size];
+	};
+};
+
+// nothing is stored in place, the base is empty
+template<std::size_t Align>
+class inline_storage<0, Align> {
+public:
+	void copy_from(const inline_storage&) noexcept {}
+	void take(inline_storage&) noexcept {}
+	void reset() noexcept {}
+	bool holds_value() const noexcept { return false; }
+
+	template<typename P>
+	P* rebase(const inline_storage&, P* p) const noexcept { return p; }
+};
+
+// operations on a type-erased owner of the object
+struct owner_ops {
+	void (*add_ref)(void* owner) noexcept;
+	void (*release)(void* owner) noexcept;
+	long (*use_count)(const void* owner) noexcept;
+	bool (*add_ref_if_alive)(void* owner) noexcept;
+	void (*add_weak_ref)(void* owner) noexcept;
+	void (*release_weak)(void* owner) noexcept;
+};
+
+// shares the ownership, knows nothing about the owned object
+class owner {
+public:
+	constexpr owner() noexcept = default;
+	owner(const owner_ops* ops, void* obj) noexcept : mOps(ops), mObj(obj) {}
+	owner(const owner& rhv) noexcept : mOps(rhv.mOps), mObj(rhv.mObj)
+	{
+		if (mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			mOps->add_ref(mObj);
+		}
+	}
+	owner(owner&& rhv) noexcept : mOps(std::exchange(rhv.mOps, nullptr)), mObj(std::exchange(rhv.mObj, nullptr)) {}
+	owner& operator=(const owner& rhv) noexcept
+	{
+		return *this = owner(rhv);
+	}
+	owner& operator=(owner&& rhv) noexcept
+	{
+		if (this != &rhv)
+		{
+			owner old{ std::move(*this) }; // released after this one takes the new owner
+			mOps = std::exchange(rhv.mOps, nullptr);
+			mObj = std::exchange(rhv.mObj, nullptr);
+		}
+		return *this;
+	}
+	~owner()
+	{
+		if (mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			mOps->release(mObj);
+		}
+	}
+
+	long use_count() const noexcept
+	{
+		if (mOps == nullptr)
+		{
+			return 0;
+		}
+		AKT_UNIFORM_PTR_COUNT(indirect_calls);
+		return mOps->use_count(mObj);
+	}
+
+	bool empty() const noexcept { return mOps == nullptr; }
+private:
+	friend class weak_owner;
+
+	const owner_ops* mOps = nullptr;
+	void* mObj = nullptr;
+};
+
+// observes an owner without sharing the ownership, keeps only the counters alive;
+// stays empty for owners which can't be observed
+class weak_owner {
+public:
+	constexpr weak_owner() noexcept = default;
+	explicit weak_owner(const owner& from) noexcept
+	{
+		if (from.mOps != nullptr && from.mOps->add_weak_ref != nullptr)
+		{
+			mOps = from.mOps;
+			mObj = from.mObj;
+			add_ref();
+		}
+	}
+	weak_owner(const weak_owner& rhv) noexcept : mOps(rhv.mOps), mObj(rhv.mObj) { add_ref(); }
+	weak_owner(weak_owner&& rhv) noexcept : mOps(std::exchange(rhv.mOps, nullptr)), mObj(std::exchange(rhv.mObj, nullptr)) {}
+	weak_owner& operator=(const weak_owner& rhv) noexcept
+	{
+		return *this = weak_owner(rhv);
+	}
+	weak_owner& operator=(weak_owner&& rhv) noexcept
+	{
+		if (this != &rhv)
+		{
+			weak_owner old{ std::move(*this) };
+			mOps = std::exchange(rhv.mOps, nullptr);
+			mObj = std::exchange(rhv.mObj, nullptr);
+		}
+		return *this;
+	}
+	~weak_owner()
+	{
+		if (mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			mOps->release_weak(mObj);
+		}
+	}
+
+	bool empty() const noexcept { return mOps == nullptr; }
+
+	// shares the ownership if the object is still alive, returns an empty owner otherwise
+	owner lock() const noexcept
+	{
+		if (mOps == nullptr)
+		{
+			return owner();
+		}
+		AKT_UNIFORM_PTR_COUNT(indirect_calls);
+		return mOps->add_ref_if_alive(mObj) ? owner{ mOps, mObj } : owner();
+	}
+
+	long use_count() const noexcept
+	{
+		if (mOps == nullptr)
+		{
+			return 0;
+		}
+		AKT_UNIFORM_PTR_COUNT(indirect_calls);
+		return mOps->use_count(mObj);
+	}
+private:
+	void add_ref() noexcept
+	{
+		if (mOps != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			mOps->add_weak_ref(mObj);
+		}
+	}
+
+	const owner_ops* mOps = nullptr;
+	void* mObj = nullptr;
+};
+
+// an object counts its owners itself if add_ref(U*) and release(U*) are found for it by argument-dependent lookup,
+// or the functions boost::intrusive_ptr uses: intrusive_ptr_add_ref(U*) and intrusive_ptr_release(U*)
+template<typename U, typename = void>
+struct has_add_ref : std::false_type {};
+
+template<typename U>
+struct has_add_ref<U, std::void_t<decltype(add_ref(std::declval<U*>()), release(std::declval<U*>()))>> : std::true_type {};
+
+template<typename U, typename = void>
+struct has_intrusive_ptr_add_ref : std::false_type {};
+
+template<typename U>
+struct has_intrusive_ptr_add_ref<U, std::void_t<decltype(intrusive_ptr_add_ref(std::declval<U*>()), intrusive_ptr_release(std::declval<U*>()))>> : std::true_type {};
+
+template<typename U, typename = void>
+struct has_use_count : std::false_type {};
+
+template<typename U>
+struct has_use_count<U, std::void_t<decltype(use_count(std::declval<const U*>()))>> : std::true_type {};
+
+template<typename U>
+inline constexpr bool is_intrusive_v = has_add_ref<U>::value || has_intrusive_ptr_add_ref<U>::value;
+
+template<typename U>
+void intrusive_add_ref(U* obj) noexcept
+{
+	AKT_UNIFORM_PTR_COUNT(ref_increments);
+	if constexpr (has_add_ref<U>::value)
+	{
+		add_ref(obj);
+	}
+	else
+	{
+		intrusive_ptr_add_ref(obj);
+	}
+}
+
+template<typename U>
+void intrusive_release(U* obj) noexcept
+{
+	AKT_UNIFORM_PTR_COUNT(ref_decrements);
+	if constexpr (has_add_ref<U>::value)
+	{
+		release(obj);
+	}
+	else
+	{
+		intrusive_ptr_release(obj);
+	}
+}
+
+// use_count(const U*) is optional, -1 stands for an unknown count
+template<typename U>
+long intrusive_use_count(const U* obj) noexcept
+{
+	if constexpr (has_use_count<U>::value)
+	{
+		return static_cast<long>(use_count(obj));
+	}
+	else
+	{
+		return -1;
+	}
+}
+
+// the object is its own owner, it has no counter of observers
+template<typename U>
+inline constexpr owner_ops intrusive_ops_for = {
+	[](void* p) noexcept { intrusive_add_ref(static_cast<U*>(p)); },
+	[](void* p) noexcept { intrusive_release(static_cast<U*>(p)); },
+	[](const void* p) noexcept { return intrusive_use_count(static_cast<const U*>(p)); },
+	nullptr,
+	nullptr,
+	nullptr
+};
+
+// a counter which has retire(block, destroy) hands the block over instead of destroying it, see reclamation_domain.hpp
+template<typename Counter, typename = void>
+struct defers_destruction : std::false_type {};
+
+template<typename Counter>
+struct defers_destruction<Counter, std::void_t<decltype(&Counter::retire)>> : std::true_type {};
+
+// counts the owners of the object, destroys the object with the last one.
+// The observers are counted apart, the block itself is freed when the object and the last observer are gone
+template<typename Counter>
+class control_block {
+	using weak_counter = typename Counter::weak_counter;
+public:
+	control_block(const control_block&) = delete;
+	control_block& operator=(const control_block&) = delete;
+
+	void add_ref() noexcept
+	{
+		AKT_UNIFORM_PTR_COUNT(ref_increments);
+		mUses.increment();
+	}
+	void release() noexcept
+	{
+		AKT_UNIFORM_PTR_COUNT(ref_decrements);
+		if (mUses.decrement() == 0)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			if constexpr (defers_destruction<Counter>::value)
+			{
+				mUses.retire(this, &control_block::destroy_retired);
+			}
+			else
+			{
+				destroy();
+			}
+		}
+	}
+	long use_count() const noexcept { return mUses.load(); }
+	bool add_ref_if_alive() noexcept { return mUses.increment_if_not_zero(); }
+
+	void add_weak_ref() noexcept { mWeak.increment(); }
+	void release_weak() noexcept
+	{
+		if (mWeak.decrement() == 0)
+		{
+			deallocate();
+		}
+	}
+
+	static const owner_ops ops;
+protected:
+	control_block() noexcept : mUses(1), mWeak(1) {}
+	virtual ~control_block() = default;
+private:
+	virtual void dispose() noexcept = 0; // destroys the object
+	virtual void deallocate() noexcept = 0; // frees the block, the object is gone already
+	void destroy() noexcept
+	{
+		dispose();
+		release_weak(); // the one held by the owners together
+	}
+	static void destroy_retired(void* block) noexcept { static_cast<control_block*>(block)->destroy(); }
+
+	Counter mUses;
+	weak_counter mWeak;
+};
+
+template<typename Counter>
+const owner_ops control_block<Counter>::ops = {
+	[](void* p) noexcept { static_cast<control_block*>(p)->add_ref(); },
+	[](void* p) noexcept { static_cast<control_block*>(p)->release(); },
+	[](const void* p) noexcept { return static_cast<const control_block*>(p)->use_count(); },
+	[](void* p) noexcept { return static_cast<control_block*>(p)->add_ref_if_alive(); },
+	[](void* p) noexcept { static_cast<control_block*>(p)->add_weak_ref(); },
+	[](void* p) noexcept { static_cast<control_block*>(p)->release_weak(); }
+};
+
+template<typename Counter>
+owner make_owner(control_block<Counter>* block) noexcept
+{
+	return owner{ &control_block<Counter>::ops, block };
+}
+
+// keeps the owned object (a value or another owning pointer) in the same allocation as the counter,
+// an observed value keeps its memory until the last observer is gone, an owning pointer only its own
+template<typename H, typename Counter>
+class holder_block final : public control_block<Counter> {
+public:
+	template<typename... Args>
+	explicit holder_block(Args&&... args) { ::new (static_cast<void*>(&mHeld)) H(std::forward<Args>(args)...); }
+
+	static void* operator new(std::size_t size)
+	{
+		AKT_UNIFORM_PTR_COUNT(allocations);
+		return ::operator new(size);
+	}
+	static void operator delete(void* p) noexcept
+	{
+		AKT_UNIFORM_PTR_COUNT(deallocations);
+		::operator delete(p);
+	}
+	// over-aligned values, the overloads above would hide the global ones
+	static void* operator new(std::size_t size, std::align_val_t align)
+	{
+		AKT_UNIFORM_PTR_COUNT(allocations);
+		return ::operator new(size, align);
+	}
+	static void operator delete(void* p, std::align_val_t align) noexcept
+	{
+		AKT_UNIFORM_PTR_COUNT(deallocations);
+		::operator delete(p, align);
+	}
+
+	H& held() noexcept { return *reinterpret_cast<H*>(&mHeld); }
+private:
+	void dispose() noexcept override { held().~H(); }
+	void deallocate() noexcept override { delete this; }
+	alignas(H) unsigned char mHeld[sizeof(H)];
+};
+
+// adopts an object which has to be destroyed by a type-erased deleter
+template<typename Counter>
+class pointer_block final : public control_block<Counter> {
+public:
+	using deleter_type = void (*)(void*) noexcept;
+
+	pointer_block(void* obj, deleter_type deleter) noexcept : mObj(obj), mDelete(deleter) {}
+
+	static void* operator new(std::size_t size)
+	{
+		AKT_UNIFORM_PTR_COUNT(allocations);
+		return ::operator new(size);
+	}
+	static void operator delete(void* p) noexcept
+	{
+		AKT_UNIFORM_PTR_COUNT(deallocations);
+		::operator delete(p);
+	}
+private:
+	void dispose() noexcept override
+	{
+		AKT_UNIFORM_PTR_COUNT(indirect_calls);
+		mDelete(mObj);
+	}
+	void deallocate() noexcept override { delete this; }
+	void* mObj;
+	deleter_type mDelete;
+};
+
+// keeps the owned value in the same allocation as the counter, both come from the allocator.
+// The value is constructed by the allocator, so allocator-aware values get it as well
+template<typename U, typename Alloc, typename Counter>
+class allocated_block final : public control_block<Counter> {
+	using block_traits = typename std::allocator_traits<Alloc>::template rebind_traits<allocated_block>;
+	using block_alloc = typename block_traits::allocator_type;
+	using value_alloc = typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+	using value_traits = std::allocator_traits<value_alloc>;
+public:
+	template<typename... Args>
+	static allocated_block* create(const Alloc& alloc, Args&&... args)
+	{
+		block_alloc blockAlloc(alloc);
+		auto mem = block_traits::allocate(blockAlloc, 1);
+		AKT_UNIFORM_PTR_COUNT(allocations);
+		allocated_block* block = std::addressof(*mem);
+		::new (static_cast<void*>(block)) allocated_block(blockAlloc);
+		try
+		{
+			value_alloc valueAlloc(blockAlloc);
+			value_traits::construct(valueAlloc, block->get(), std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			block->~allocated_block();
+			AKT_UNIFORM_PTR_COUNT(deallocations);
+			block_traits::deallocate(blockAlloc, mem, 1);
+			throw;
+		}
+		return block;
+	}
+
+	U* get() noexcept { return reinterpret_cast<U*>(&mValue); }
+private:
+	explicit allocated_block(const block_alloc& alloc) noexcept : mAlloc(alloc) {}
+
+	void dispose() noexcept override
+	{
+		value_alloc valueAlloc(mAlloc);
+		value_traits::destroy(valueAlloc, get());
+	}
+	void deallocate() noexcept override
+	{
+		block_alloc blockAlloc(std::move(mAlloc));
+		this->~allocated_block();
+		AKT_UNIFORM_PTR_COUNT(deallocations);
+		block_traits::deallocate(blockAlloc, std::pointer_traits<typename block_traits::pointer>::pointer_to(*this), 1);
+	}
+
+	block_alloc mAlloc;
+	alignas(U) unsigned char mValue[sizeof(U)];
+};
+
+}
+
+// move-only counterpart of uniform_ptr: owns the object exclusively, no control block and no reference counting.
+// It turns into a shared uniform_ptr only by the explicit uniform_ptr constructor.
 template<typename T>
-class uniform_ptr {
+class uniform_unique_ptr {
+public:
+	constexpr uniform_unique_ptr(std::nullptr_t = nullptr) noexcept {}
+
+	template<typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*> && std::is_move_constructible_v<U> && !std::is_reference_v<U>, int> = 0>
+	uniform_unique_ptr(U&& val) : uniform_unique_ptr(make_object<U>(std::forward<U>(val))) {}
+
+	// doesn't own the object
+	template<typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	constexpr uniform_unique_ptr(U* const val) noexcept : mPtr(val) {}
+
+	template <typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_unique_ptr(std::unique_ptr<U> val) noexcept : mPtr(val.get()), mObj(val.get()), mDelete(val ? &delete_object<U> : nullptr)
+	{
+		val.release();
+	}
+
+	uniform_unique_ptr(const uniform_unique_ptr&) = delete;
+	uniform_unique_ptr& operator=(const uniform_unique_ptr&) = delete;
+
+	uniform_unique_ptr(uniform_unique_ptr&& rhv) noexcept : mPtr(std::exchange(rhv.mPtr, nullptr)), mObj(std::exchange(rhv.mObj, nullptr)), mDelete(std::exchange(rhv.mDelete, nullptr)) {}
+	uniform_unique_ptr& operator=(uniform_unique_ptr&& rhv) noexcept
+	{
+		if (this != &rhv)
+		{
+			assign(std::move(rhv));
+		}
+		return *this;
+	}
+
+	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_unique_ptr(uniform_unique_ptr<U>&& rhv) noexcept : mPtr(std::exchange(rhv.mPtr, nullptr)), mObj(std::exchange(rhv.mObj, nullptr)), mDelete(std::exchange(rhv.mDelete, nullptr)) {}
+
+	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_unique_ptr& operator=(uniform_unique_ptr<U>&& rhv) noexcept
+	{
+		assign(std::move(rhv));
+		return *this;
+	}
+
+	~uniform_unique_ptr()
+	{
+		if (mDelete != nullptr)
+		{
+			AKT_UNIFORM_PTR_COUNT(indirect_calls);
+			mDelete(mObj);
+		}
+	}
+public:
+	constexpr operator bool() const noexcept { return get() != nullptr; }
+	T& operator*() const noexcept
+	{
+		return *get();
+	}
+	T* operator->() const noexcept
+	{
+		return get();
+	}
+
+	constexpr T* get() const noexcept
+	{
+		return mPtr;
+	}
+
+	bool owns() const noexcept
+	{
+		return mDelete != nullptr;
+	}
+private:
+	template<typename U>
+	friend class uniform_unique_ptr;
+	template<typename U, typename P>
+	friend class uniform_ptr;
+
+	using deleter_type = void (*)(void*) noexcept;
+
+	template<typename U, typename... Args>
+	static std::unique_ptr<U> make_object(Args&&... args)
+	{
+		AKT_UNIFORM_PTR_COUNT(allocations);
+		return std::make_unique<U>(std::forward<Args>(args)...);
+	}
+
+	template<typename U>
+	static void delete_object(void* obj) noexcept
+	{
+		AKT_UNIFORM_PTR_COUNT(deallocations);
+		delete static_cast<U*>(obj);
+	}
+
+	template<typename U>
+	void assign(uniform_unique_ptr<U>&& rhv) noexcept
+	{
+		uniform_unique_ptr old{ std::move(*this) };
+		mPtr = std::exchange(rhv.mPtr, nullptr);
+		mObj = std::exchange(rhv.mObj, nullptr);
+		mDelete = std::exchange(rhv.mDelete, nullptr);
+	}
+
+	T* mPtr = nullptr;
+	void* mObj = nullptr; // the object as it was allocated, mPtr may point to its base
+	deleter_type mDelete = nullptr; // nullptr for non-owning pointers
+};
+
+// uniform_ptr keeps the pointer to the object next to a type-erased ownership handle:
+// get() is a plain load, the handle is touched only when the uniform_ptr is copied or destroyed
+template<typename T, typename Policy = default_policy>
+class uniform_ptr : private detail::inline_storage<Policy::inline_size, Policy::inline_align> {
+	using storage_type = detail::inline_storage<Policy::inline_size, Policy::inline_align>;
+	using counter_type = typename Policy::counter_type;
 public:
-	uniform_ptr(nullptr_t = nullptr) : mF([]() -> T* { return nullptr; }) {}
+	constexpr uniform_ptr(std::nullptr_t = nullptr) noexcept {}
 
 	// makes a copy of original value
-	template<typename U = T, std::enable_if_t<std::is_copy_constructible_v<U>, int> = 0 >
-	uniform_ptr(const U & val) : mF([p = std::make_shared<U>(val)]()  -> T* { return p.get(); }) {}
+	template<typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*> && std::is_copy_constructible_v<U>, int> = 0 >
+	uniform_ptr(const U & val) { emplace<U>(val); }
 
 	template<typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*> && std::is_move_constructible_v<U> && !std::is_reference_v<U>, int> = 0>
-	uniform_ptr(U&& val) : mF([p = std::make_shared<U>(std::forward<U>(val))]() ->T* { return p.get(); }) {}
+	uniform_ptr(U&& val) { emplace<U>(std::forward<U>(val)); }
+
+	// constructs U from args right in its final storage
+	template<typename U, typename... Args, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	explicit uniform_ptr(std::in_place_type_t<U>, Args&&... args) { emplace<U>(std::forward<Args>(args)...); }
 
+	// the value and the counter are allocated by alloc, the value is never stored in place
+	template<typename Alloc, typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*> && std::is_copy_constructible_v<U>, int> = 0>
+	uniform_ptr(std::allocator_arg_t, const Alloc& alloc, const U& val) : uniform_ptr(std::allocator_arg, alloc, std::in_place_type<U>, val) {}
+
+	template<typename Alloc, typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*> && std::is_move_constructible_v<U> && !std::is_reference_v<U>, int> = 0>
+	uniform_ptr(std::allocator_arg_t, const Alloc& alloc, U&& val) : uniform_ptr(std::allocator_arg, alloc, std::in_place_type<U>, std::forward<U>(val)) {}
+
+	template<typename Alloc, typename U, typename... Args, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_ptr(std::allocator_arg_t, const Alloc& alloc, std::in_place_type_t<U>, Args&&... args)
+	{
+		auto block = detail::allocated_block<U, Alloc, counter_type>::create(alloc, std::forward<Args>(args)...);
+		mPtr = block->get();
+		mOwner = detail::make_owner<counter_type>(block);
+	}
+
+	// doesn't own the object, a namespace-scope handle made this way is constant-initialized
 	template<typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr(U* const val) : mF([p = val]() -> T* { return p; }) {}
+	constexpr uniform_ptr(U* const val) noexcept : mPtr(val) {}
+
+	// shares the ownership of an object which counts its owners itself, see detail::is_intrusive_v: no block is allocated,
+	// copies of the handle count on the object. With addRef false the handle takes over a reference the caller holds.
+	// Such an object isn't destroyed through the policy and can't be observed by uniform_weak_ptr;
+	// use_count() is -1 unless use_count(const U*) is found for it as well
+	template<typename U, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_ptr(intrusive_t, U* val, bool addRef = true) noexcept
+	{
+		using object_type = std::remove_cv_t<U>;
+		static_assert(detail::is_intrusive_v<object_type>, "no add_ref and release found for the type");
+		if (val != nullptr)
+		{
+			object_type* const obj = const_cast<object_type*>(val);
+			if (addRef)
+			{
+				detail::intrusive_add_ref(obj);
+			}
+			mPtr = val;
+			mOwner = detail::owner{ &detail::intrusive_ops_for<object_type>, obj };
+		}
+	}
+
+	// takes the object of any source described by uniform_source_traits
+	template<typename Src, typename Traits = uniform_source_traits<std::remove_cv_t<std::remove_reference_t<Src>>>,
+		typename Object = std::remove_pointer_t<decltype(Traits::get(std::declval<std::remove_reference_t<Src>&>()))>,
+		std::enable_if_t<std::is_convertible_v<Object*, T*>, int> = 0>
+	uniform_ptr(Src&& src)
+	{
+		using source_type = std::remove_cv_t<std::remove_reference_t<Src>>;
+		using element_type = typename Traits::element_type;
+		Object* const obj = Traits::get(src);
+		if (obj == nullptr)
+		{
+			return;
+		}
+		if constexpr (Traits::kind == uniform_source_kind::borrowed)
+		{
+			mPtr = obj;
+		}
+		else if constexpr (Traits::kind == uniform_source_kind::kept)
+		{
+			auto block = new detail::holder_block<source_type, counter_type>(std::forward<Src>(src));
+			mPtr = Traits::get(block->held());
+			mOwner = detail::make_owner<counter_type>(block);
+		}
+		else if constexpr (std::is_lvalue_reference_v<Src> || std::is_const_v<std::remove_reference_t<Src>>)
+		{
+			emplace<element_type>(static_cast<const element_type&>(*obj));
+		}
+		else
+		{
+			emplace<element_type>(std::move(*obj));
+		}
+	}
+
+	// keeps a copy of the shared_ptr in a block of its own, copies of uniform_ptr are counted by the policy:
+	// one allocation on top of those of the shared_ptr, make_uniform constructs the object with none more
+	template <typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_ptr(std::shared_ptr<U> val)
+	{
+		if (val != nullptr)
+		{
+			auto block = new detail::holder_block<std::shared_ptr<U>, counter_type>(std::move(val));
+			mPtr = block->held().get();
+			mOwner = detail::make_owner<counter_type>(block);
+		}
+	}
 
 	template <typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr(std::shared_ptr<U> val) : mF([p = val]() -> T* { return p.get(); }) {}
+	uniform_ptr(std::unique_ptr<U> val) : uniform_ptr(uniform_unique_ptr<U>(std::move(val))) {}
 
+	// takes over the exclusive ownership, the object becomes shared
 	template <typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr(std::unique_ptr<U> val) : mF([p = std::shared_ptr(std::move(val))]() -> T* { return p.get(); }) {}
+	explicit uniform_ptr(uniform_unique_ptr<U>&& val)
+	{
+		if (val.mDelete != nullptr)
+		{
+			auto block = new detail::pointer_block<counter_type>(val.mObj, val.mDelete);
+			mOwner = detail::make_owner<counter_type>(block);
+			val.mObj = nullptr;
+			val.mDelete = nullptr;
+		}
+		mPtr = std::exchange(val.mPtr, nullptr);
+	}
 
 	// copy and move ctors
-	uniform_ptr(const uniform_ptr<T>& rhv) = default;
-	uniform_ptr(uniform_ptr<T>&& rhv) noexcept : mF(std::move(rhv.mF)) {}
-	uniform_ptr<T>& operator=(const uniform_ptr<T>& rhv) = default;
-	uniform_ptr<T>& operator=(uniform_ptr<T>&& rhv) noexcept
+	uniform_ptr(const uniform_ptr& rhv) : storage_type(rhv), mPtr(this->rebase(rhv, rhv.mPtr)), mOwner(rhv.mOwner) {}
+	uniform_ptr(uniform_ptr&& rhv) noexcept : storage_type(std::move(rhv)), mPtr(this->rebase(rhv, std::exchange(rhv.mPtr, nullptr))), mOwner(std::move(rhv.mOwner)) {}
+	uniform_ptr& operator=(const uniform_ptr& rhv)
 	{
 		if (this != &rhv)
 		{
-			mF = std::move(rhv.mF);
+			assign(uniform_ptr(rhv));
+		}
+		return *this;
+	}
+	uniform_ptr& operator=(uniform_ptr&& rhv) noexcept
+	{
+		if (this != &rhv)
+		{
+			assign(std::move(rhv));
 		}
 		return *this;
 	}
 
+	// converted handle shares the ownership of the source one and caches the adjusted pointer,
+	// so it is never deeper than the original one no matter how many times it was converted
 	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr(const uniform_ptr<U>& rhv) : mF([p = rhv]() mutable -> T* {return p.get(); }) {}
+	uniform_ptr(const uniform_ptr<U, Policy>& rhv) : storage_type(rhv), mPtr(this->rebase(rhv, static_cast<T*>(rhv.mPtr))), mOwner(rhv.mOwner) {}
 
 	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr(uniform_ptr<U>&& rhv) noexcept : mF([p = std::forward<uniform_ptr<U>>(rhv)]() mutable -> T* {return p.get(); }) {}
+	uniform_ptr(uniform_ptr<U, Policy>&& rhv) noexcept : storage_type(std::move(rhv)), mPtr(this->rebase(rhv, static_cast<T*>(std::exchange(rhv.mPtr, nullptr)))), mOwner(std::move(rhv.mOwner)) {}
 
 	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr<T>& operator=(const uniform_ptr<U>& rhv)
+	uniform_ptr& operator=(const uniform_ptr<U, Policy>& rhv)
 	{
-		mF = [p = rhv]() mutable -> T* {return p.get(); };
+		assign(uniform_ptr<U, Policy>(rhv));
 		return *this;
 	}
 
 	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
-	uniform_ptr<T>& operator=(uniform_ptr<U>&& rhv)
+	uniform_ptr& operator=(uniform_ptr<U, Policy>&& rhv) noexcept
 	{
-		mF = [p = std::move(rhv)]() mutable -> T* {return p.get(); };
+		assign(std::move(rhv));
 		return *this;
 	}
 
+	// handles with different policies never share the ownership
+	template<typename U, typename P, std::enable_if_t<!std::is_same_v<P, Policy>, int> = 0>
+	uniform_ptr(const uniform_ptr<U, P>& rhv) = delete;
+	template<typename U, typename P, std::enable_if_t<!std::is_same_v<P, Policy>, int> = 0>
+	uniform_ptr& operator=(const uniform_ptr<U, P>& rhv) = delete;
+
 	~uniform_ptr() = default; // non virtual <- inheritance is possible, but I don't see any reason to have 'pointer to pointer'
 public:
-	operator bool() const { return get() != nullptr; }
-	T& operator*() const
+	constexpr operator bool() const noexcept { return get() != nullptr; }
+	T& operator*() const noexcept
 	{
 		return *get();
 	}
-	T* operator->() const
+	T* operator->() const noexcept
 	{
 		return get();
 	}
 
-	T* get() const
+	constexpr T* get() const noexcept
+	{
+		return mPtr;
+	}
+
+	// number of owners sharing the object, 0 for non-owning pointers
+	long use_count() const noexcept
 	{
-		return mF();
+		return this->holds_value() ? 1 : mOwner.use_count();
 	}
 private:
-	std::function<T*(void)> mF;
+	template<typename U, typename P>
+	friend class uniform_ptr;
+	template<typename U, typename P>
+	friend class uniform_weak_ptr;
+
+	uniform_ptr(T* ptr, detail::owner&& owner) noexcept : mPtr(ptr), mOwner(std::move(owner)) {}
+
+	template<typename U, typename... Args>
+	void emplace(Args&&... args)
+	{
+		if constexpr (detail::fits_inline_v<U, Policy>)
+		{
+			mPtr = this->template construct<U>(std::forward<Args>(args)...);
+		}
+		else
+		{
+			auto block = new detail::holder_block<U, counter_type>(std::forward<Args>(args)...);
+			mPtr = &block->held();
+			mOwner = detail::make_owner<counter_type>(block);
+		}
+	}
+
+	template<typename U>
+	void assign(uniform_ptr<U, Policy>&& rhv) noexcept
+	{
+		storage_type::reset();
+		storage_type::take(rhv);
+		mPtr = this->rebase(rhv, static_cast<T*>(std::exchange(rhv.mPtr, nullptr)));
+		mOwner = std::move(rhv.mOwner);
+	}
+
+	T* mPtr = nullptr;
+	detail::owner mOwner; // empty for non-owning pointers and values stored in place
 };
 
+// observes the object of a uniform_ptr without owning it, lock() shares the ownership while the object is alive.
+// Intrusively counted objects can't be observed, a weak pointer to one of them is expired from the start.
+// Only the counters of an expired object stay allocated, and its memory if it was allocated together with them.
+// A weak pointer made from a non-owning uniform_ptr never expires: the object is assumed to outlive it, as it is
+// assumed to outlive the uniform_ptr. Values stored in place live and die with their handle, they can't be observed.
+template<typename T, typename Policy = default_policy>
+class uniform_weak_ptr {
+	static_assert(Policy::inline_size == 0, "values stored in place can't be observed");
+public:
+	constexpr uniform_weak_ptr(std::nullptr_t = nullptr) noexcept {}
+
+	// expired at once if the owner can't be observed.
+	// A handle made from a kept source such as std::shared_ptr owns the block holding its copy of the source, and
+	// that block is what is observed: the weak pointer expires with the last uniform_ptr, even while owners outside
+	// of it, other std::shared_ptr copies, keep the object alive
+	template<typename U = T, std::enable_if_t<std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_weak_ptr(const uniform_ptr<U, Policy>& ptr) noexcept : mPtr(ptr.mPtr), mOwner(ptr.mOwner)
+	{
+		if (mOwner.empty() && !ptr.mOwner.empty())
+		{
+			mPtr = nullptr;
+		}
+	}
+
+	uniform_weak_ptr(const uniform_weak_ptr&) = default;
+	uniform_weak_ptr(uniform_weak_ptr&& rhv) noexcept : mPtr(std::exchange(rhv.mPtr, nullptr)), mOwner(std::move(rhv.mOwner)) {}
+	uniform_weak_ptr& operator=(const uniform_weak_ptr&) = default;
+	uniform_weak_ptr& operator=(uniform_weak_ptr&& rhv) noexcept
+	{
+		mPtr = std::exchange(rhv.mPtr, nullptr);
+		mOwner = std::move(rhv.mOwner);
+		return *this;
+	}
+
+	// the pointer of an expired object may not be converted any more, an expired source gives an expired copy
+	template<typename U, std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U*, T*>, int> = 0>
+	uniform_weak_ptr(const uniform_weak_ptr<U, Policy>& rhv) noexcept : uniform_weak_ptr(rhv.lock()) {}
+
+	// empty if the object is gone
+	uniform_ptr<T, Policy> lock() const noexcept
+	{
+		if (mOwner.empty())
+		{
+			return uniform_ptr<T, Policy>(mPtr, detail::owner());
+		}
+		detail::owner owner = mOwner.lock();
+		return owner.empty() ? uniform_ptr<T, Policy>() : uniform_ptr<T, Policy>(mPtr, std::move(owner));
+	}
+
+	bool expired() const noexcept
+	{
+		return mOwner.empty() ? mPtr == nullptr : mOwner.use_count() == 0;
+	}
+private:
+	T* mPtr = nullptr; // dangles once the object is gone, used only after lock() succeeded
+	detail::weak_owner mOwner; // empty for non-owning pointers
+};
+
+// constructs U from args in place, with one allocation at most; U may be neither copyable nor movable
+template<typename T, typename U = T, typename Policy = default_policy, typename... Args>
+uniform_ptr<T, Policy> make_uniform(Args&&... args)
+{
+	return uniform_ptr<T, Policy>(std::in_place_type<U>, std::forward<Args>(args)...);
+}
+
+// constructs U from args in memory of the resource, the resource has to outlive all copies of the pointer
+template<typename T, typename U = T, typename Policy = default_policy, typename... Args>
+uniform_ptr<T, Policy> make_uniform_pmr(std::pmr::memory_resource* resource, Args&&... args)
+{
+	return uniform_ptr<T, Policy>(std::allocator_arg, std::pmr::polymorphic_allocator<U>(resource), std::in_place_type<U>, std::forward<Args>(args)...);
+}
+
 }
 
 #endif // !_UNIFORM_PTR_HPP_